@@ -475,20 +475,20 @@ void txn_order_status(fast_random &r, uint32_t warehouse_id, threadinfo *ti,
   }
 
 #ifdef ORIGIN_TPCC
-  // find largest order id
-  COUT_N_EXIT("fix to rscan before use");
+  // find largest order id, the first one of a reverse scan
   OrderCidIndexKey o_c_idx_0(warehouse_id, district_id, customer_id, 0);
-  std::vector<std::pair<OrderCidIndexKey, OrderCidIndexVal>> order_cid_kvs;
   OrderCidIndexKey o_c_idx_1(warehouse_id, district_id, customer_id,
                              std::numeric_limits<uint32_t>::max());
-  size_t ret = table_order_index->range_scan(o_c_idx_0, o_c_idx_1,
-                                             order_cid_kvs, ti, q, worker_id);
-  INVARIANT(ret == order_cid_kvs.size());
-  if (order_cid_kvs.size() == 0) {
+  uint32_t newest_o_id = 0;
+  size_t ret = table_order_index->range_visit(o_c_idx_0, o_c_idx_1,
+      [&](Str key, Str /* value */) {
+        newest_o_id = ((OrderCidIndexKey *)key.data())->to_normal_key().oc_o_id;
+        return false;
+      }, ti, true);
+  if (ret == 0) {
     COUT_THIS("abort order status, no order under such customer");
     return;
   }
-  uint32_t newest_o_id = order_cid_kvs.back().first.oc_o_id;
 #else
   uint32_t newest_o_id =
       latest_order_id_per_customer[warehouse_id - 1][district_id - 1]
@@ -95,6 +95,7 @@ uint64_t cold_percentage_upper_bound = 90;
 uint64_t hot_percentage_lower_bound = 5;
 uint64_t cold_percentage_lower_bound = 80;
 size_t test_data_set_size = 20000000;
+uint64_t stats_interval = 0;  // ms between two memory stats dumps, 0 disables them
 
 /**********************************************************************
  * parse command line args
@@ -135,9 +136,10 @@ inline void parse_args(int argc, char **argv) {
       {"cold-percentage-lower-bound", required_argument, 0, 'H'},
       // cxl config
       {"cxl-percentage", required_argument, 0, 'I'},
+      {"stats-interval", required_argument, 0, 'J'},
       {0, 0, 0, 0}};
   std::string ops =
-      "a:b:c:d:e:f:g:h:i:j:k:l:m:n:o:p:q:r:s:t:u:v:w:x:y:z:A:B:C:D:E:F:H:I";
+      "a:b:c:d:e:f:g:h:i:j:k:l:m:n:o:p:q:r:s:t:u:v:w:x:y:z:A:B:C:D:E:F:H:I:J:";
   int option_index = 0;
 
   while (1) {
@@ -269,6 +271,15 @@ inline void parse_args(int argc, char **argv) {
       cxl_percentage = strtol(optarg, NULL, 10);
       INVARIANT(cxl_percentage <= 100);
       break;
+    case 'J': {
+      stats_interval = strtol(optarg, NULL, 10);
+      // count the allocations of every tier from cxl_init on
+      struct cxl_config config;
+      cxl_get_config(&config);
+      config.stats = stats_interval > 0;
+      cxl_set_config(&config);
+      break;
+    }
     default:
       abort();
     }
@@ -297,6 +308,7 @@ inline void parse_args(int argc, char **argv) {
   COUT_VAR(zipfian_theta);
   COUT_VAR(stat_op_latency);
   COUT_VAR(sample_lat_rate);
+  COUT_VAR(stats_interval);
 }
 
 /**********************************************************************
@@ -787,18 +799,11 @@ inline void prepare_masstree(tab_mt_t *&table, threadinfo *main_ti,
 
 inline void prepare_art(tab_art_t *&table) {
   INVARIANT(table == nullptr);
-  query<row_type> q;  // not used
   table = new tab_art_t(cxl_percentage, max_local_memory_usage);
-  uint64_t id = 0;
-  for (auto iter = all_keys.begin(); iter != all_keys.end(); iter++) {
-    if (id % 10000000 == 0) {
-      printf("insert %ld\n", id);
-    }
-    ++id;
-    bool res = table->insert(*iter, default_val, nullptr, q, 0);
-    INVARIANT(res);
-    UNUSED(res);
-  }
+  printf("bulk load %zu keys\n", all_keys.size());
+  bool res = table->bulk_load(all_keys, default_val);
+  INVARIANT(res);
+  UNUSED(res);
   table->init_migration_worker(
     fg_n, basic_worker_wakeup_interval, cooler_wakeup_interval,
     threshold_adjuster_wakeup_interval);
@@ -827,14 +832,26 @@ void start_micro() {
   if (target == "masstree") {
     prepare_masstree(tab_mt, main_ti, q);
     timeit();
+    sidle::start_stats_dumper(stats_interval);
     run_benchmark(tab_mt, runtime, main_ti);
   } else if (target == "art") {
     prepare_art(tab_art);
     timeit();
+    sidle::start_stats_dumper(stats_interval);
     run_benchmark(tab_art, runtime, main_ti);
   } else {
     COUT_N_EXIT("the fuck?");
   }
+  if (stats_interval > 0) {
+    sidle::stop_stats_dumper();
+    sidle::dump_memory_stats(stdout);
+    if (target == "art") {
+      art::art_retry_stats retry;
+      art::adaptive_radix_tree_get_retry_stats(&retry);
+      printf("[art stats] restarts from the root: %lu, forwarded to a replacement node: %lu\n",
+             retry.restarts, retry.forwards);
+    }
+  }
   
   if (tab_mt != nullptr) {
     delete tab_mt;
@@ -1,7 +1,9 @@
 #if !defined(ART_H)
 #define ART_H
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -25,6 +27,7 @@ class ARTKV {
  using demotion_executor_t = sidle::art_demotion_executor<art::leaf_node, art::art_node, art::adaptive_radix_tree, art::art_node>;
  using threshold_adjuster_t = sidle::art_threshold_adjuster;
  using cooler_t = sidle::art_cooler<art::leaf_node, art::art_node, art::adaptive_radix_tree, art::art_node>;
+ using compactor_t = sidle::art_compactor<art::leaf_node, art::art_node, art::adaptive_radix_tree, art::art_node>;
  using tree_op_t = sidle::tree_op<art::leaf_node, art::art_node, art::adaptive_radix_tree, art::art_node>;
  
  public:
@@ -33,23 +36,24 @@ class ARTKV {
 
   bool get(const K &k, V &v, threadinfo *ti, query<row_type> &q,
            const uint32_t worker_id);
+  /// @brief get the values of n keys with interleaved lookups
+  /// @return the number of keys found, found[i] tells whether values[i] is set
+  size_t multi_get(const K *keys, size_t n, V *values, bool *found, threadinfo *ti,
+                   query<row_type> &q, const uint32_t worker_id);
   bool insert(const K &k, const V &v, threadinfo *ti, query<row_type> &q,
               const uint32_t worker_id);
+  /// @brief build the empty tree from keys, all with value v
+  /// @param threads the builders, 0 for the hardware concurrency
+  bool bulk_load(const std::vector<K> &keys, const V &v, int threads = 0);
   bool remove(const K &k, threadinfo *ti, query<row_type> &q,
               const uint32_t worker_id);
-  bool lower_bound(K& /* k */, V& /* v */, threadinfo* /* ti */, query<row_type>& /* q */,
-                   const uint32_t /* worker_id */) {
-    return false;
-  }
-  size_t scan(const K& /* k_start */, size_t /* n */, std::vector<std::pair<K, V>>& /* result */,
-              threadinfo* /* ti */, query<row_type>& /* q */, const uint32_t /* worker_id */) {
-    return 0;
-  }
-  size_t range_scan(const K& /* k_start */, const K& /* k_end */,
-                    std::vector<std::pair<K, V>>& /* result */, threadinfo* /* ti */,
-                    query<row_type>& /* q */, const uint32_t /* worker_id */) {
-    return 0;
-  }
+  bool lower_bound(K &k, V &v, threadinfo *ti, query<row_type> &q,
+                   const uint32_t worker_id);
+  size_t scan(const K &k_start, size_t n, std::vector<std::pair<K, V>> &result,
+              threadinfo *ti, query<row_type> &q, const uint32_t worker_id);
+  size_t range_scan(const K &k_start, const K &k_end,
+                    std::vector<std::pair<K, V>> &result, threadinfo *ti,
+                    query<row_type> &q, const uint32_t worker_id);
   void worker_enter(const uint32_t /* worker_id */) {};
   void worker_exit(const uint32_t /* worker_id */ ) {};
 
@@ -62,6 +66,12 @@ class ARTKV {
 
  private:
   static const size_t key_size = sizeof(K);
+  static V leaf_value(art::leaf_node *leaf) {
+    V v{};
+    art::art_leaf_read_value(leaf, &v, sizeof(V));
+    return v;
+  }
+
   art::adaptive_radix_tree *tree;
   std::vector<worker_base_ptr_t> background_workers;
   std::vector<std::thread> background_jobs;
@@ -121,19 +131,43 @@ template <typename K, typename V>
 bool ARTKV<K, V>::get(const K &k, V &v, threadinfo* /* ti */, query<row_type>& /* q */,
            const uint32_t /* worker_id */) {
   K str_k = k.to_str_key();
-  void *value = art::adaptive_radix_tree_get(tree, (char *)&str_k, key_size);
-  if (value == nullptr) {
-    return false;
+  return art::adaptive_radix_tree_get_value(tree, (char *)&str_k, key_size, &v, sizeof(V)) >= 0;
+}
+
+template <typename K, typename V>
+size_t ARTKV<K, V>::multi_get(const K *keys, size_t n, V *values, bool *found, threadinfo* /* ti */,
+                              query<row_type>& /* q */, const uint32_t /* worker_id */) {
+  std::vector<K> str_keys(n);
+  std::vector<const void *> key_ptrs(n);
+  std::vector<size_t> lens(n, key_size);
+  std::vector<art::leaf_node *> leaves(n);
+  for (size_t i = 0; i < n; ++i) {
+    str_keys[i] = keys[i].to_str_key();
+    key_ptrs[i] = &str_keys[i];
   }
-  v = *((V *)value);
-  return true;
+  sidle::epoch_guard guard;
+  size_t ret = art::adaptive_radix_tree_multi_get(tree, key_ptrs.data(), lens.data(), n, leaves.data());
+  for (size_t i = 0; i < n; ++i) {
+    found[i] = leaves[i] != nullptr;
+    if (!found[i]) {
+      continue;
+    }
+    values[i] = leaf_value(leaves[i]);
+    if (unlikely(art::art_leaf_value_is_moved(leaves[i]))) {
+      // the leaf was migrated or removed meanwhile, look it up again
+      found[i] = art::adaptive_radix_tree_get_value(tree, (char *)&str_keys[i], key_size,
+                                                    &values[i], sizeof(V)) >= 0;
+      ret -= !found[i];
+    }
+  }
+  return ret;
 }
 
 template <typename K, typename V>
-bool ARTKV<K, V>::insert(const K &k, const V& /* v */, threadinfo* /* ti */,
+bool ARTKV<K, V>::insert(const K &k, const V &v, threadinfo* /* ti */,
                               query<row_type>& /* q */, const uint32_t /* worker_id */) {
   K str_k = k.to_str_key();
-  int ret = art::adaptive_radix_tree_put(tree, (char *)&str_k, key_size);
+  int ret = art::adaptive_radix_tree_put(tree, (char *)&str_k, key_size, &v, sizeof(V));
   if (ret == 0 || ret == 1) {
     return true;
   }
@@ -141,9 +175,73 @@ bool ARTKV<K, V>::insert(const K &k, const V& /* v */, threadinfo* /* ti */,
 }
 
 template <typename K, typename V>
-bool ARTKV<K, V>::remove(const K & /* k */, threadinfo* /* ti */, query<row_type>& /* q */,
+bool ARTKV<K, V>::bulk_load(const std::vector<K> &keys, const V &v, int threads) {
+  std::vector<K> str_keys;
+  str_keys.reserve(keys.size());
+  for (const auto &k : keys) {
+    str_keys.push_back(k.to_str_key());
+  }
+  std::sort(str_keys.begin(), str_keys.end(), [](const K &a, const K &b) {
+    return memcmp(&a, &b, key_size) < 0;
+  });
+  std::vector<art::art_bulk_entry> entries(str_keys.size());
+  for (size_t i = 0; i < str_keys.size(); ++i) {
+    entries[i] = art::art_bulk_entry{&str_keys[i], key_size, &v, sizeof(V)};
+  }
+  return art::adaptive_radix_tree_bulk_load(tree, entries.data(), entries.size(), threads) == 0;
+}
+
+template <typename K, typename V>
+bool ARTKV<K, V>::remove(const K &k, threadinfo* /* ti */, query<row_type>& /* q */,
                               const uint32_t /* worker_id */) {
-  return false;
+  K str_k = k.to_str_key();
+  return art::adaptive_radix_tree_remove(tree, (char *)&str_k, key_size) == 0;
+}
+
+template <typename K, typename V>
+bool ARTKV<K, V>::lower_bound(K &k, V &v, threadinfo* /* ti */, query<row_type>& /* q */,
+                              const uint32_t /* worker_id */) {
+  K str_k = k.to_str_key();
+  art::art_iterator it;
+  art::art_iterator_init(&it, tree);
+  art::art_iterator_seek(&it, (char *)&str_k, key_size);
+  art::leaf_node *leaf = art::art_iterator_next(&it);
+  if (leaf == nullptr) {
+    return false;
+  }
+  k = ((K *)leaf->key)->to_normal_key();
+  v = leaf_value(leaf);
+  art::art_iterator_close(&it);
+  return true;
+}
+
+template <typename K, typename V>
+size_t ARTKV<K, V>::scan(const K &k_start, size_t n, std::vector<std::pair<K, V>> &result,
+                         threadinfo* /* ti */, query<row_type>& /* q */,
+                         const uint32_t /* worker_id */) {
+  K str_k = k_start.to_str_key();
+  art::art_iterator it;
+  art::art_iterator_init(&it, tree);
+  art::art_iterator_seek(&it, (char *)&str_k, key_size);
+  art::leaf_node *leaf;
+  for (size_t i = 0; i < n && (leaf = art::art_iterator_next(&it)) != nullptr; ++i) {
+    result.emplace_back(((K *)leaf->key)->to_normal_key(), leaf_value(leaf));
+  }
+  art::art_iterator_close(&it);
+  return result.size();
+}
+
+template <typename K, typename V>
+size_t ARTKV<K, V>::range_scan(const K &k_start, const K &k_end,
+                               std::vector<std::pair<K, V>> &result, threadinfo* /* ti */,
+                               query<row_type>& /* q */, const uint32_t /* worker_id */) {
+  K str_start = k_start.to_str_key(), str_end = k_end.to_str_key();
+  art::adaptive_radix_tree_range_scan(tree, (char *)&str_start, key_size,
+                                      (char *)&str_end, key_size, [&](art::leaf_node *leaf) {
+    result.emplace_back(((K *)leaf->key)->to_normal_key(), leaf_value(leaf));
+    return true;
+  });
+  return result.size();
 }
 
 template <typename K, typename V>
@@ -156,18 +254,27 @@ void ARTKV<K, V>::init_migration_worker(int bg_worker_start_tid,
 #ifndef CAL_NODE_HOTNESS
   sidle::sidle_threshold* thresholds = 
                                   sidle::strategy_manager.get_threshold_manager();
-  histogram_ptr_t histogram = std::make_shared<sidle::sidle_histogram>(thresholds);
+  // the trigger counts the leaves of each traversal worker in a slot of the histogram
+  sidle::init_traverse_workers();
+  histogram_ptr_t histogram = std::make_shared<sidle::sidle_histogram>(
+      thresholds, 16, sidle::traverse_workers.worker_count());
   tree_op_t art_ops = tree_op_t{
     .traverse_func_ = art::adaptive_radix_tree_traverse,
+    .parallel_traverse_func_ = art::adaptive_radix_tree_traverse_mt,
     .leaf_migration_ = art::leaf_migration,
-    .internode_migration_ = art::internode_migration,
+    .internode_migration_ = [t = tree](art::art_node* an, sidle::node_mem_type target_type,
+                                     bool need_lock_first) {
+      return art::internode_migration(an, target_type, need_lock_first, t);
+    },
     .unlock_ = art::unlock_node,
     .node_traverse_func_ = art::art_node_traverse,
     .get_leaf_ = art::get_art_leaf,
     .is_leaf_ = art::is_art_leaf,
+    .get_parent_ = [t = tree](art::art_node* an) { return art::get_art_parent(t, an); },
     .type_ = sidle::tree_type::art,
   };
-  int worker_count = 5;
+  // the compactor runs only when the local chunks are tracked, see SIDLE_COMPACTION
+  int worker_count = sidle::node_allocator.compaction() ? 6 : 5;
   background_workers.resize(worker_count, nullptr);
   background_workers[0] = std::make_shared<migration_trigger_t>(
       std::chrono::milliseconds(basic_worker_wakeup_interval * 5), tree, histogram, art_ops);
@@ -180,8 +287,11 @@ void ARTKV<K, V>::init_migration_worker(int bg_worker_start_tid,
             std::chrono::milliseconds(cooler_wakeup_interval * 5), tree, histogram, art_ops);
   background_workers[4] = std::make_shared<threshold_adjuster_t>(
             std::chrono::milliseconds(threshold_adjuster_wakeup_interval), histogram);
+  if (worker_count > 5) {
+    background_workers[5] = std::make_shared<compactor_t>(
+            std::chrono::milliseconds(cooler_wakeup_interval), tree, art_ops);
+  }
   background_jobs.reserve(worker_count);
-  art::init_thread_pool(bg_worker_start_tid + worker_count);
   for (int i = 0; i < worker_count; ++i) {
     if (background_workers[i] == nullptr) {
       continue;
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <memory>
+#include <type_traits>
 #include <set>
 #include <vector>
 
@@ -24,20 +25,31 @@
 #if !defined(MASSTREE_H)
 #define MASSTREE_H
 
-typedef Masstree::default_table mass_tree_t;
+/// @brief values up to this size are stored in the leaves, see Masstree::inline_query_table_params.
+/// Define it as 0 to keep every value behind a row pointer. A leaf of 64-byte values with its key
+/// suffixes fills the largest pooled allocation, Masstree::leaf rejects larger ones at compile time
+#ifndef MASSTREE_INLINE_VALUE_SIZE
+#define MASSTREE_INLINE_VALUE_SIZE 64
+#endif
+
+/// @brief the parameters of the tree of a MasstreeKV with values of type V
+template <typename V>
+using mass_params_t = std::conditional_t<(sizeof(V) <= MASSTREE_INLINE_VALUE_SIZE),
+                                         Masstree::inline_query_table_params<sizeof(V)>,
+                                         Masstree::default_query_table_params>;
+template <typename P> using mass_tree_t = Masstree::query_table<P>;
 using worker_base_ptr_t = std::shared_ptr<sidle::art_worker_base>;
 using histogram_ptr_t = std::shared_ptr<sidle::sidle_histogram>;
-using mass_leaf_t = Masstree::leaf<Masstree::default_query_table_params>;
-using mass_internode_t = Masstree::internode<Masstree::default_query_table_params>;
-using mass_node_t = Masstree::node_base<Masstree::default_query_table_params>;
-using masstree_t = Masstree::basic_table<Masstree::default_query_table_params>;
-using mass_migration_trigger_t = sidle::art_migration_trigger<mass_leaf_t, mass_internode_t, masstree_t, mass_node_t, threadinfo*>;
-using mass_promotion_executor_t = sidle::art_promotion_executor<mass_leaf_t, mass_internode_t, masstree_t, mass_node_t, threadinfo*>;
-using mass_demotion_executor_t = sidle::art_demotion_executor<mass_leaf_t, mass_internode_t, masstree_t, mass_node_t, threadinfo*>;
-using mass_cooler_t = sidle::art_cooler<mass_leaf_t, mass_internode_t, masstree_t, mass_node_t, threadinfo*>;
+template <typename P> using mass_leaf_t = Masstree::leaf<P>;
+template <typename P> using mass_internode_t = Masstree::internode<P>;
+template <typename P> using mass_node_t = Masstree::node_base<P>;
+template <typename P> using masstree_t = Masstree::basic_table<P>;
+template <typename P> using mass_migration_trigger_t = sidle::art_migration_trigger<mass_leaf_t<P>, mass_internode_t<P>, masstree_t<P>, mass_node_t<P>, threadinfo*>;
+template <typename P> using mass_promotion_executor_t = sidle::art_promotion_executor<mass_leaf_t<P>, mass_internode_t<P>, masstree_t<P>, mass_node_t<P>, threadinfo*>;
+template <typename P> using mass_demotion_executor_t = sidle::art_demotion_executor<mass_leaf_t<P>, mass_internode_t<P>, masstree_t<P>, mass_node_t<P>, threadinfo*>;
+template <typename P> using mass_cooler_t = sidle::art_cooler<mass_leaf_t<P>, mass_internode_t<P>, masstree_t<P>, mass_node_t<P>, threadinfo*>;
 using mass_threshold_adjuster_t = sidle::art_threshold_adjuster;
-using mass_tree_op_t = sidle::tree_op<mass_leaf_t, mass_internode_t, masstree_t, mass_node_t, threadinfo*>;
-
+template <typename P> using mass_tree_op_t = sidle::tree_op<mass_leaf_t<P>, mass_internode_t<P>, masstree_t<P>, mass_node_t<P>, threadinfo*>;
 
 struct MigrationJob {
   sidle::worker_type type;
@@ -50,8 +62,11 @@ class MasstreeKV {
   static const size_t val_size = sizeof(V);
 
  public:
-  typedef typename mass_tree_t::leaf_type leaf_type;
-  typedef typename mass_tree_t::node_type node_type;
+  typedef mass_params_t<V> params_type;
+  typedef typename mass_tree_t<params_type>::leaf_type leaf_type;
+  typedef typename mass_tree_t<params_type>::node_type node_type;
+  /// @brief the values are stored in the leaves rather than behind row pointers
+  static constexpr bool inline_values = !std::is_pointer_v<typename params_type::value_type>;
   MasstreeKV(threadinfo *main_ti, const int cxl_percentage, const uint64_t max_local_memory_usage);
   ~MasstreeKV();
   bool get(const K &k, V &v, threadinfo *ti, query<row_type> &q,
@@ -60,13 +75,33 @@ class MasstreeKV {
               const uint32_t worker_id);
   bool remove(const K &k, threadinfo *ti, query<row_type> &q,
               const uint32_t worker_id);
+  /// @brief find the first record whose key is not less than k, and replace k with its key
   bool lower_bound(K &k, V &v, threadinfo *ti, query<row_type> &q,
                    const uint32_t worker_id);
   size_t scan(const K &k_start, size_t n, std::vector<std::pair<K, V>> &result,
               threadinfo *ti, query<row_type> &q, const uint32_t worker_id);
+  /// @brief visit the records from k_start on in key order without copying them
+  /// @param visitor is called as bool(Str key, Str value) with views into the leaf and the row that
+  /// are valid only during the call, the key in the stored (string-ordered) form. It returns
+  /// false to stop the scan
+  /// @param reverse visit the records from k_start down in reverse key order
+  /// @return the number of records visited
+  template <typename F>
+  size_t scan_visit(const K &k_start, F &&visitor, threadinfo *ti, bool reverse = false);
+  /// @brief visit the records in [k_start, k_end] like scan_visit, the scan stops at the first key
+  /// past the range
+  /// @param reverse visit the range from k_end down to k_start
+  template <typename F>
+  size_t range_visit(const K &k_start, const K &k_end, F &&visitor, threadinfo *ti,
+                     bool reverse = false);
+  /// @brief append the records in [k_start, k_end] to result in key order
   size_t range_scan(const K &k_start, const K &k_end,
                     std::vector<std::pair<K, V>> &result, threadinfo *ti,
                     query<row_type> &q, const uint32_t worker_id);
+  /// @brief append the records in [k_start, k_end] to result in reverse key order
+  size_t reverse_range_scan(const K &k_start, const K &k_end,
+                            std::vector<std::pair<K, V>> &result, threadinfo *ti,
+                            query<row_type> &q, const uint32_t worker_id);
   void worker_enter(const uint32_t worker_id);
   void worker_exit(const uint32_t worker_id);
   void stop();
@@ -81,7 +116,7 @@ class MasstreeKV {
   void terminate_bg();
 
  private:
-  mass_tree_t mass_tree;
+  mass_tree_t<params_type> mass_tree;
   std::vector<worker_base_ptr_t> background_workers;
   std::vector<std::thread> background_jobs;
   threadinfo *main_ti;
@@ -92,6 +127,8 @@ MasstreeKV<K, V>::MasstreeKV(threadinfo *main_ti, const int cxl_percentage, cons
   sidle::strategy_manager = sidle::sidle_strategy(max_local_memory_usage, cxl_percentage, false);
   printf("[DEBUG] max_local_memory_usage: %lu\n", max_local_memory_usage);
   node_type::strategy_manager = &sidle::strategy_manager;
+  sidle::init_local_arena();
+  Masstree::init_value_migration();
   mass_tree.initialize(*main_ti, cxl_percentage);
 }
 
@@ -153,17 +190,27 @@ bool MasstreeKV<K, V>::get(const K &k, V &v, threadinfo *ti, query<row_type> &q,
                            const uint32_t worker_id) {
   K str_k = k.to_str_key();
   Str key((char *)&str_k, key_size);
-  Str val_str;
-  bool got = q.run_get1(mass_tree.table(), key, 0, val_str, *ti);
-  if (got) {
-    try {
-      v = *((V *)val_str.s);
-    } catch (const std::exception &e) {
-      std::cerr << "Exception in MasstreeKV::get: " << e.what() << std::endl;
+  if constexpr (inline_values) {
+    // the value was copied out of the leaf with its slot, under the version check of the leaf
+    typename mass_tree_t<params_type>::unlocked_cursor_type lp(mass_tree.table(), key);
+    bool found = lp.find_unlocked(*ti);
+    if (found) {
+      v = *(V *)lp.value().col(0).data();
     }
-    return true;
+    return found;
+  } else {
+    Str val_str;
+    bool got = q.run_get1(mass_tree.table(), key, 0, val_str, *ti);
+    if (got) {
+      try {
+        v = *((V *)val_str.s);
+      } catch (const std::exception &e) {
+        std::cerr << "Exception in MasstreeKV::get: " << e.what() << std::endl;
+      }
+      return true;
+    }
+    return false;
   }
-  return false;
 }
 
 template <typename K, typename V>
@@ -171,10 +218,24 @@ bool MasstreeKV<K, V>::insert(const K &k, const V &v, threadinfo *ti,
                               query<row_type> &q, const uint32_t worker_id) {
   K str_k = k.to_str_key();
   Str key((char *)&str_k, key_size);
-  Str val((char *)&v, val_size);
- result_t res = q.run_replace(mass_tree.table(), key, val, *ti);
-  assert(res == Inserted || res == Updated);
-  return res == Inserted || res == Updated;
+  if constexpr (inline_values) {
+    typename mass_tree_t<params_type>::cursor_type lp(mass_tree.table(), key);
+    bool found = lp.find_insert(*ti);
+    if (found) {
+      // the value is overwritten in place, its readers retry on the version of the leaf
+      lp.node()->mark_insert();
+    } else {
+      ti->observe_phantoms(lp.node());
+    }
+    lp.value().assign(&v);
+    lp.finish(1, *ti);
+    return true;
+  } else {
+    Str val((char *)&v, val_size);
+    result_t res = q.run_replace(mass_tree.table(), key, val, *ti);
+    assert(res == Inserted || res == Updated);
+    return res == Inserted || res == Updated;
+  }
 }
 
 template <typename K, typename V>
@@ -182,7 +243,13 @@ bool MasstreeKV<K, V>::remove(const K &k, threadinfo *ti, query<row_type> &q,
                               const uint32_t worker_id) {
   K str_k = k.to_str_key();
   Str key((char *)&str_k, key_size);
-  q.run_remove(mass_tree.table(), key, *ti);
+  if constexpr (inline_values) {
+    typename mass_tree_t<params_type>::cursor_type lp(mass_tree.table(), key);
+    bool found = lp.find_locked(*ti);
+    lp.finish(found ? -1 : 0, *ti);
+  } else {
+    q.run_remove(mass_tree.table(), key, *ti);
+  }
   return true;
 }
 
@@ -190,8 +257,14 @@ template <typename K, typename V>
 bool MasstreeKV<K, V>::lower_bound(K &k, V &v, threadinfo *ti,
                                    query<row_type> &q,
                                    const uint32_t worker_id) {
-  throw std::runtime_error("MasstreeKV::lower_bound not implemented");
-  return false;
+  bool found = false;
+  scan_visit(k, [&](Str key, Str value) {
+    k = ((K *)key.data())->to_normal_key();
+    v = *(V *)value.data();
+    found = true;
+    return false;
+  }, ti);
+  return found;
 }
 
 template <typename K, typename V>
@@ -199,17 +272,46 @@ size_t MasstreeKV<K, V>::scan(const K &k_start, size_t n,
                               std::vector<std::pair<K, V>> &result,
                               threadinfo *ti, query<row_type> &q,
                               const uint32_t worker_id) {
+  if (n == 0) {
+    return result.size();
+  }
+  scan_visit(k_start, [&](Str key, Str value) {
+    result.emplace_back(((K *)key.data())->to_normal_key(), *(V *)value.data());
+    return --n != 0;
+  }, ti);
+  return result.size();
+}
+
+template <typename K, typename V>
+template <typename F>
+size_t MasstreeKV<K, V>::scan_visit(const K &k_start, F &&visitor, threadinfo *ti, bool reverse) {
   K str_k = k_start.to_str_key();
   Str first_key((char *)&str_k, key_size);
-  lcdf::Json req = lcdf::Json::array(0, 0, first_key, n);
-  q.run_scan(mass_tree.table(), req, *ti);
-  assert(req.size() >= 2);
-
-  for (int i = 2; i < req.size(); i += 2) {
-    result.emplace_back(((K *)req[i].as_s().data())->to_normal_key(),
-                        *(V *)req[i + 1].as_s().data());
+  visitor_scanner<row_type, std::remove_reference_t<F>> scanner(visitor);
+  if (reverse) {
+    mass_tree.table().rscan(first_key, true, scanner, *ti);
+  } else {
+    mass_tree.table().scan(first_key, true, scanner, *ti);
   }
-  return result.size();
+  return scanner.count();
+}
+
+template <typename K, typename V>
+template <typename F>
+size_t MasstreeKV<K, V>::range_visit(const K &k_start, const K &k_end, F &&visitor,
+                                     threadinfo *ti, bool reverse) {
+  // the keys are compared in the stored form, in which byte order is key order
+  K str_bound = reverse ? k_start.to_str_key() : k_end.to_str_key();
+  size_t count = 0;
+  scan_visit(reverse ? k_end : k_start, [&](Str key, Str value) {
+    int cmp = memcmp(key.data(), &str_bound, key_size);
+    if (reverse ? cmp < 0 : cmp > 0) {
+      return false;
+    }
+    ++count;
+    return static_cast<bool>(visitor(key, value));
+  }, ti, reverse);
+  return count;
 }
 
 template <typename K, typename V>
@@ -217,8 +319,23 @@ size_t MasstreeKV<K, V>::range_scan(const K &k_start, const K &k_end,
                                     std::vector<std::pair<K, V>> &result,
                                     threadinfo *ti, query<row_type> &q,
                                     const uint32_t worker_id) {
-  throw std::runtime_error("MasstreeKV::range_scan not implemented");
-  return 0;
+  range_visit(k_start, k_end, [&](Str key, Str value) {
+    result.emplace_back(((K *)key.data())->to_normal_key(), *(V *)value.data());
+    return true;
+  }, ti);
+  return result.size();
+}
+
+template <typename K, typename V>
+size_t MasstreeKV<K, V>::reverse_range_scan(const K &k_start, const K &k_end,
+                                            std::vector<std::pair<K, V>> &result,
+                                            threadinfo *ti, query<row_type> &q,
+                                            const uint32_t worker_id) {
+  range_visit(k_start, k_end, [&](Str key, Str value) {
+    result.emplace_back(((K *)key.data())->to_normal_key(), *(V *)value.data());
+    return true;
+  }, ti, true);
+  return result.size();
 }
 
 template <typename K, typename V>
@@ -232,17 +349,23 @@ void MasstreeKV<K, V>::init_migration_worker(int bg_worker_start_tid, int basic_
   // prepare the histogram
   sidle::sidle_threshold* thresholds = sidle::strategy_manager.get_threshold_manager();
   thresholds->set_hotness_watermarks(hot_percentage_lower_bound);
-  histogram_ptr_t histogram = std::make_shared<sidle::sidle_histogram>(thresholds);
+  // the trigger counts the leaves of each traversal worker in a slot of the histogram
+  sidle::init_traverse_workers();
+  histogram_ptr_t histogram = std::make_shared<sidle::sidle_histogram>(
+      thresholds, 16, sidle::traverse_workers.worker_count());
   background_workers.clear();
   int worker_count = 5;
-  mass_tree_op_t masstree_ops = mass_tree_op_t {
-    .traverse_func_ = Masstree::masstree_leaf_traverse<Masstree::default_query_table_params, threadinfo*>,
-    .leaf_migration_ = Masstree::masstree_leaf_migration<Masstree::default_query_table_params, threadinfo*>,
-    .internode_migration_ = Masstree::masstree_internode_migration<Masstree::default_query_table_params, threadinfo*>,
-    .unlock_ = Masstree::masstree_unlock<Masstree::default_query_table_params>,
-    .node_traverse_func_ = Masstree::masstree_internode_traverse<Masstree::default_query_table_params>,
-    .get_leaf_ = Masstree::masstree_get_leaf<Masstree::default_query_table_params>,
-    .is_leaf_ = Masstree::masstree_is_leaf<Masstree::default_query_table_params>,
+  mass_tree_op_t<params_type> masstree_ops = mass_tree_op_t<params_type> {
+    .traverse_func_ = Masstree::masstree_leaf_traverse<params_type, threadinfo*>,
+    .parallel_traverse_func_ = Masstree::masstree_leaf_traverse_mt<params_type, threadinfo*>,
+    .leaf_migration_ = Masstree::masstree_leaf_migration<params_type, threadinfo*>,
+    .internode_migration_ = Masstree::masstree_internode_migration<params_type, threadinfo*>,
+    .unlock_ = Masstree::masstree_unlock<params_type>,
+    .node_traverse_func_ = Masstree::masstree_internode_traverse<params_type>,
+    .get_leaf_ = Masstree::masstree_get_leaf<params_type>,
+    .is_leaf_ = Masstree::masstree_is_leaf<params_type>,
+    // the internode demotion that walks up to the parent is art only
+    .get_parent_ = nullptr,
     .type_ = sidle::tree_type::masstree,
   };
 #ifdef WATERMARK_RECORD
@@ -250,15 +373,17 @@ void MasstreeKV<K, V>::init_migration_worker(int bg_worker_start_tid, int basic_
   worker_count = 6;
 #endif
 #endif
+  // no compactor: masstree frees its nodes into the per-thread pools of threadinfo, the local chunks of
+  // the node slab never drain
   printf("[DEBUG] basic_worker_wakeup_interval: %d, cooler_wakeup_interval: %d, threshold_adjuster_wakeup_interval: %d\n", basic_worker_wakeup_interval, cooler_wakeup_interval, threshold_adjuster_wakeup_interval);
   background_workers.resize(worker_count);
-  background_workers[0] = std::make_shared<mass_migration_trigger_t>(
+  background_workers[0] = std::make_shared<mass_migration_trigger_t<params_type>>(
   std::chrono::milliseconds(basic_worker_wakeup_interval), &mass_tree.table(), histogram, masstree_ops);
-  background_workers[1] = std::make_shared<mass_promotion_executor_t>(
+  background_workers[1] = std::make_shared<mass_promotion_executor_t<params_type>>(
     thresholds, std::chrono::milliseconds(basic_worker_wakeup_interval), masstree_ops);
-  background_workers[2] = std::make_shared<mass_demotion_executor_t>(
+  background_workers[2] = std::make_shared<mass_demotion_executor_t<params_type>>(
     thresholds, std::chrono::milliseconds(basic_worker_wakeup_interval), masstree_ops);
-  background_workers[3] = std::make_shared<mass_cooler_t>(
+  background_workers[3] = std::make_shared<mass_cooler_t<params_type>>(
     std::chrono::milliseconds(cooler_wakeup_interval), &mass_tree.table(), histogram, masstree_ops);
   background_workers[4] = std::make_shared<mass_threshold_adjuster_t>(
     std::chrono::milliseconds(threshold_adjuster_wakeup_interval), histogram);
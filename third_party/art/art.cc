@@ -7,22 +7,24 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cassert>
-#ifdef Debug
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#ifdef Debug
 #include <cstdio>
 #endif
 
 #include "art.hh"
-#include "thread_pool.h"
 #include "sidle_meta.hh"
+#include "sidle_copy.hh"
 
 // #define RECORD_ART_LEVEL
 namespace art {
 
 /* ------------------------ func from art_node.cc ------------------------------*/
 
-static ThreadPool *pool;
-
 uint64_t art_node_get_version(art_node *an)
 {
   uint64_t version;
@@ -57,6 +59,90 @@ inline void art_node_set_parent_unsafe(art_node *an, art_node *parent)
 
 /* ------------------------ end func from art_node.cc --------------------------*/
 
+// lookups and updates that restarted from the root, and nodes followed to their replacement
+static std::atomic<uint64_t> art_restarts{0};
+static std::atomic<uint64_t> art_forwards{0};
+
+// return the node that took the place of an old node, or 0 if the node was removed
+static inline art_node* adaptive_radix_tree_forward(art_node *an)
+{
+  art_node *new_ = art_node_get_new_node(an);
+  if (new_)
+    art_forwards.fetch_add(1, std::memory_order_relaxed);
+  return new_;
+}
+
+static inline void adaptive_radix_tree_count_restart()
+{
+  art_restarts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void adaptive_radix_tree_get_retry_stats(art_retry_stats *stats)
+{
+  stats->restarts = art_restarts.load(std::memory_order_relaxed);
+  stats->forwards = art_forwards.load(std::memory_order_relaxed);
+}
+
+// find the parent of `an` by descending from the root along `key`, a key below `an`, without
+// the parent pointers. Return the slot of `an` and set *parent, 0 if `an` is the root, or
+// return 0 if `an` is not met, because a writer changed the path or `an` left the tree
+static art_node** adaptive_radix_tree_descend_to(art_node **root, art_node *an, const void *key,
+                                                 size_t len, art_node **parent)
+{
+  size_t off = art_node_version_get_offset(art_node_get_version(an));
+  art_node **slot = root;
+  *parent = 0;
+  // every node on the way consumes at least one byte of the key
+  for (size_t depth = 0; depth <= off; ++depth) {
+    art_node *cur;
+    __atomic_load(slot, &cur, __ATOMIC_ACQUIRE);
+    if (cur == an)
+      return slot;
+    if (cur == 0 || is_leaf(cur))
+      return 0;
+    uint64_t v = art_node_get_stable_expand_version(cur);
+    size_t pos = art_node_version_get_offset(v) + art_node_version_get_prefix_len(v);
+    if (pos >= off)
+      return 0;
+    art_node **next = art_node_find_child(cur, v, pos < len ? ((unsigned char *)key)[pos] : 0);
+    if (next == 0)
+      return 0;
+    *parent = cur;
+    slot = next;
+  }
+  return 0;
+}
+
+// lock the parent of a locked node that is still in the tree and set *parent, 0 if it is the root.
+// Without parent pointers the parent is found along `key`, a key below the node, and the lookup
+// is given up after a few attempts like lock_migration_parent.
+// return 0 on success, 1 if the parent was not found and nothing is locked
+static int adaptive_radix_tree_lock_parent(art_node **root, art_node *an, const void *key,
+                                           size_t len, art_node **parent)
+{
+  if (art_parent_ptrs) {
+    *parent = art_node_get_locked_parent(an);
+    return 0;
+  }
+  for (int attempt = 0; attempt < 8; ++attempt) {
+    art_node *child;
+    art_node **slot = adaptive_radix_tree_descend_to(root, an, key, len, parent);
+    if (unlikely(slot == 0))
+      continue;
+    // the root is only replaced by a writer holding it
+    if (*parent == 0)
+      return 0;
+    if (unlikely(art_node_lock(*parent)))
+      continue;
+    __atomic_load(slot, &child, __ATOMIC_ACQUIRE);
+    if (likely(child == an))
+      return 0;
+    art_node_unlock(*parent);
+  }
+  *parent = 0;
+  return 1;
+}
+
 adaptive_radix_tree* new_adaptive_radix_tree(int cxl_percentage,
                                             uint64_t local_memory_amount)
 {
@@ -68,7 +154,17 @@ adaptive_radix_tree* new_adaptive_radix_tree(int cxl_percentage,
   // init the sidle strategy manager
   cxl_init(CXL_MAX_SIZE, cxl_percentage);
   sidle::strategy_manager = sidle::sidle_strategy(local_memory_amount, cxl_percentage);
+  sidle::init_local_arena();
 #endif
+  const char *env = getenv("SIDLE_ART_INLINE_VALUE_SIZE");
+  if (env) {
+    size_t size = strtoull(env, nullptr, 10);
+    art_inline_value_size = size < art_max_inline_value_size ? size : art_max_inline_value_size;
+  }
+  env = getenv("SIDLE_ART_LEAF_TAGS");
+  art_leaf_tags = env != nullptr && atoi(env) != 0;
+  env = getenv("SIDLE_ART_NO_PARENT_PTRS");
+  art_parent_ptrs = env == nullptr || atoi(env) == 0;
   adaptive_radix_tree *art = static_cast<adaptive_radix_tree *>(malloc(sizeof(adaptive_radix_tree)));
   art->root = 0;
 
@@ -84,14 +180,14 @@ void free_adaptive_radix_tree(adaptive_radix_tree *art)
 // return +1 on existed,
 // return -1 on retry
 static int adaptive_radix_tree_replace_leaf(art_node *parent, art_node **ptr, art_node *an,
-  const void *key, size_t len, size_t off)
+  const void *key, size_t len, size_t off, const void *value, size_t value_len)
 {
-  art_node *new_ = art_node_replace_leaf_child(parent, an, key, len, off);
+  art_node *new_ = art_node_replace_leaf_child(parent, an, key, len, off, value, value_len);
   if (likely(new_)) {
     if (likely(parent)) {
       if (unlikely(art_node_lock(parent))) {
         // parent is old
-        free_art_node(new_);
+        free_unpublished_art_node(new_, an);
         return -1;
       } else {
         art_node *now;
@@ -99,7 +195,7 @@ static int adaptive_radix_tree_replace_leaf(art_node *parent, art_node **ptr, ar
         if (unlikely(now != an)) {
           // leaf has been replaced by another thread
           art_node_unlock(parent);
-          free_art_node(new_);
+          free_unpublished_art_node(new_, an);
           return -1;
         }
         __atomic_store(ptr, &new_, __ATOMIC_RELEASE);
@@ -108,13 +204,22 @@ static int adaptive_radix_tree_replace_leaf(art_node *parent, art_node **ptr, ar
         return 0;
       }
     } else { // art with only one leaf
-      if (likely(__atomic_compare_exchange_n(ptr, &an, new_, 0 /* weak */, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))) {
+      art_node *expected = an;
+      if (likely(__atomic_compare_exchange_n(ptr, &expected, new_, 0 /* weak */, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))) {
         return 0;
       } else {
-        free_art_node(new_);
+        free_unpublished_art_node(new_, an);
         return -1;
       }
     }
+  } else if (value) {
+    // key exists, overwrite its value in place
+    leaf_node *leaf = get_leaf(reinterpret_cast<char*>(an));
+    if (unlikely(art_leaf_value_lock(leaf)))
+      return -1; // leaf has been migrated or removed
+    art_leaf_write_value(leaf, value, value_len);
+    art_leaf_value_unlock(leaf, 0);
+    return 1;
   } else {
     return 1;
   }
@@ -123,7 +228,8 @@ static int adaptive_radix_tree_replace_leaf(art_node *parent, art_node **ptr, ar
 // return  0 on success,
 // return +1 on existed,
 // return -1 for retry
-static int _adaptive_radix_tree_put(art_node *parent, art_node **ptr, const void *key, size_t len, size_t off)
+static int _adaptive_radix_tree_put(art_node **root, art_node *parent, art_node **ptr, const void *key,
+  size_t len, size_t off, const void *value, size_t value_len)
 {
   art_node *an;
   int first = 1;
@@ -137,53 +243,67 @@ static int _adaptive_radix_tree_put(art_node *parent, art_node **ptr, const void
     // we need to make sure that `ptr` is still valid because `parent` might changed
     uint64_t pv = art_node_get_version(parent);
     if (art_node_version_is_old(pv))
-      return -1; // return -1 so that we can retry from root
+      return -1; // return -1 so that the caller retries from the replacement of parent
     // `ptr` is still valid, we can proceed
   }
 
   // NOTE: __ATOMIC_RELAXED is not ok
   __atomic_load(ptr, &an, __ATOMIC_ACQUIRE);
 
+  // slot emptied by a delete, or the art became empty
+  if (unlikely(an == 0))
+    return -1;
+
   if (unlikely(is_leaf(an)))
-    return adaptive_radix_tree_replace_leaf(parent, ptr, an, key, len, off);
+    return adaptive_radix_tree_replace_leaf(parent, ptr, an, key, len, off, value, value_len);
 
 #ifdef CAL_NODE_HOTNESS
   ++an->access_count;
 #endif
 
+  forward:
   // verify node prefix
   uint64_t v = art_node_get_stable_expand_version(an);
-  if (unlikely(art_node_version_get_offset(v) != off))
+  if (unlikely(art_node_version_is_old(v))) {
+    // continue from the node that replaced it instead of from the root
+    if ((an = adaptive_radix_tree_forward(an)))
+      goto forward;
     goto begin;
+  }
 
-  if (unlikely(art_node_version_is_old(v)))
+  if (unlikely(art_node_version_get_offset(v) != off))
     goto begin;
 
   int p = art_node_prefix_compare(an, v, key, len, off);
 
   uint64_t v1 = art_node_get_version(an);
   if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
-    goto begin;
+    goto forward;
   v = v1;
 
   if (p != art_node_version_get_prefix_len(v)) {
     if (unlikely(art_node_lock(an)))
-      goto begin;
+      goto forward;
     // still need to check whether prefix has been changed!
     if (unlikely(art_node_version_compare_expand(v, art_node_get_version_unsafe(an)))) {
       art_node_unlock(an);
-      goto begin;
+      goto forward;
     }
     debug_assert_art(art_node_version_is_old(art_node_get_version_unsafe(an)) == 0);
-    parent = art_node_get_locked_parent(an);
-    art_node *new_ = art_node_expand_and_insert(parent, an, key, len, off, p);
+    // `parent` is kept for the validation at `begin` if the lookup fails
+    art_node *locked_parent;
+    if (unlikely(adaptive_radix_tree_lock_parent(root, an, key, len, &locked_parent))) {
+      art_node_unlock(an);
+      goto forward;
+    }
+    art_node *new_ = art_node_expand_and_insert(locked_parent, an, key, len, off, p, value, value_len);
     art_node_set_parent_unsafe(an, new_);
-    if (likely(parent)) {
+    if (likely(locked_parent)) {
       debug_assert_art(off);
-      art_node_replace_child(parent, ((unsigned char *)key)[off - 1], an, new_);
-      art_node_unlock(parent);
+      art_node_replace_child(locked_parent, ((unsigned char *)key)[off - 1], an, new_);
+      art_node_unlock(locked_parent);
     } else { // this is root
-      __atomic_store(ptr, &new_, __ATOMIC_RELEASE);
+      __atomic_store(root, &new_, __ATOMIC_RELEASE);
     }
     art_node_unlock(an);
     return 0;
@@ -195,61 +315,400 @@ static int _adaptive_radix_tree_put(art_node *parent, art_node **ptr, const void
   // prefix is matched, we can descend
   art_node **next = art_node_find_child(an, v, ((unsigned char *)key)[off]);
 
-  v = art_node_get_version(an);
+  v1 = art_node_get_version(an);
 
-  if (unlikely(art_node_version_is_old(v))) {
+  // a delete moves children around under the expand bit
+  if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1))) {
     off -= p;
-    goto begin;
+    goto forward;
   }
 
-  if (next)
-    return _adaptive_radix_tree_put(an, next, key, len, off + 1);
+  int ret;
+  if (next) {
+    if (likely((ret = _adaptive_radix_tree_put(root, an, next, key, len, off + 1, value, value_len)) != -1))
+      return ret;
+    // the slot of the child went stale, find it again in this node or its replacement
+    off -= p;
+    goto forward;
+  }
 
   if (unlikely(art_node_lock(an))) {
     off -= p;
-    goto begin;
+    goto forward;
+  }
+
+  // a full node grows into a new one, its parent is held before the node is replaced
+  art_node *locked_parent = 0;
+  int grow = art_node_is_full(an);
+  if (unlikely(grow && adaptive_radix_tree_lock_parent(root, an, key, len, &locked_parent))) {
+    art_node_unlock(an);
+    off -= p;
+    goto forward;
   }
 
   art_node *new_ = 0;
   next = art_node_add_child(an, ((unsigned char *)key)[off], 
-                            (art_node *)alloc_leaf(an, key, len), &new_);
+                            (art_node *)alloc_leaf(an, key, len, sidle::node_mem_type::remote,
+                                                   false, value, value_len), &new_);
+  if (unlikely(grow && !new_ && locked_parent)) {
+    // the byte was inserted meanwhile, the node stays
+    art_node_unlock(locked_parent);
+  }
   if (unlikely(new_)) {
-    parent = art_node_get_locked_parent(an);
-    if (likely(parent)) {
+    if (likely(locked_parent)) {
       debug_assert_art((int)off > p);
-      art_node_replace_child(parent, ((unsigned char *)key)[off - p - 1], an, new_);
-      art_node_unlock(parent);
+      art_node_replace_child(locked_parent, ((unsigned char *)key)[off - p - 1], an, new_);
+      art_node_unlock(locked_parent);
     } else {
-      __atomic_store(ptr, &new_, __ATOMIC_RELEASE);
+      __atomic_store(root, &new_, __ATOMIC_RELEASE);
     }
   }
   art_node_unlock(an);
 
   // another thread might inserted same byte before we acquire lock
-  if (unlikely(next))
-    return _adaptive_radix_tree_put(an, next, key, len, off + 1);
+  if (unlikely(next)) {
+    if (likely((ret = _adaptive_radix_tree_put(root, an, next, key, len, off + 1, value, value_len)) != -1))
+      return ret;
+    off -= p;
+    goto forward;
+  }
 
   return 0;
 }
 
 // return 0 on success
-// return 1 on duplication
-int adaptive_radix_tree_put(adaptive_radix_tree *art, const void *key, size_t len)
+// return 1 on duplication, the value of the existing key is overwritten if value is given
+int adaptive_radix_tree_put(adaptive_radix_tree *art, const void *key, size_t len,
+  const void *value, size_t value_len)
 {
   //print_key(key, len);
 
-  art_node *root = art->root;
-  if (unlikely(root == 0)) { // empty art
-    art_node *leaf = (art_node *)alloc_leaf(nullptr, key, len);
-    // art_node *leaf = (art_node *)make_leaf(key);
-    if (__atomic_compare_exchange_n(&art->root, &root, leaf, 0 /* weak */, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+  sidle::epoch_guard guard;
+  int ret;
+  // retry should be rare
+  for (int attempt = 0;; ++attempt) {
+    if (attempt)
+      adaptive_radix_tree_count_restart();
+    art_node *root;
+    __atomic_load(&art->root, &root, __ATOMIC_ACQUIRE);
+    if (unlikely(root == 0)) { // empty art, a delete may empty it again
+      art_node *leaf = (art_node *)alloc_leaf(nullptr, key, len, sidle::node_mem_type::remote,
+                                              false, value, value_len);
+      // art_node *leaf = (art_node *)make_leaf(key);
+      if (__atomic_compare_exchange_n(&art->root, &root, leaf, 0 /* weak */, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        return 0;
+      // else another thread has replaced empty root
+      free_art_leaf(get_leaf(reinterpret_cast<char*>(leaf)));
+    }
+    if (likely((ret = _adaptive_radix_tree_put(&art->root, 0 /* parent */, &art->root, key, len, 0 /* off */,
+                                               value, value_len)) != -1))
+      return ret;
+  }
+}
+
+// a subtree of a bulk load, built by one thread once the top of the tree is in place
+struct art_bulk_task
+{
+  art_node *parent;
+  unsigned char byte;
+  const art_bulk_entry *entries;
+  size_t n;
+  size_t off;
+  art_node *child;
+  int64_t local_bytes;
+};
+
+struct art_bulk_context
+{
+  uint8_t local_depth; // the deepest level placed in local memory
+  size_t cutoff;       // ranges up to this many entries are left to the builders
+  std::vector<art_bulk_task> *tasks;
+  std::vector<art_node *> *top;
+};
+
+static inline unsigned char bulk_key_byte(const art_bulk_entry *e, size_t off)
+{
+  return off < e->len ? ((const unsigned char *)e->key)[off] : 0;
+}
+
+static inline int bulk_key_compare(const art_bulk_entry *a, const art_bulk_entry *b)
+{
+  int cmp = memcmp(a->key, b->key, std::min(a->len, b->len));
+  return cmp ? cmp : (a->len > b->len) - (a->len < b->len);
+}
+
+// build the subtree of entries sharing their first off bytes, return a node or a leaf.
+// The top of the tree, built with a context holding tasks, leaves its large ranges to the builders.
+static art_node* bulk_build(art_node *parent, const art_bulk_entry *e, size_t n, size_t off,
+                            art_bulk_context *ctx, int64_t *local_bytes)
+{
+  // the common prefix of a sorted range is the one of its first and last key
+  const art_bulk_entry *first = &e[0], *last = &e[n - 1];
+  const char *k1 = (const char *)first->key, *k2 = (const char *)last->key;
+  size_t i = off, max = std::min(first->len, last->len);
+  for (; i < max && k1[i] == k2[i]; ++i)
+    ;
+  if (i == first->len && i == last->len)
+    return (art_node *)alloc_leaf(parent, last->key, last->len, sidle::node_mem_type::remote,
+                                  false, last->value, last->value_len);
+
+  // a longer prefix is split over a chain of nodes with a single child
+  int prefix_len = std::min(i - off, (size_t)8);
+  size_t pos = off + prefix_len;
+  int count = 1;
+  for (size_t j = 1; j < n; ++j)
+    count += bulk_key_byte(&e[j], pos) != bulk_key_byte(&e[j - 1], pos);
+
+  uint8_t depth = parent == nullptr ? 1 : parent->sidle_meta.depth + 1;
+  sidle::node_mem_type type = depth <= ctx->local_depth ? sidle::node_mem_type::local
+                                                        : sidle::node_mem_type::remote;
+  art_node *an = new_art_node_bulk(parent, count, type, k1, off, prefix_len);
+  if (type == sidle::node_mem_type::local)
+    *local_bytes += art_node_size(an->version);
+  if (art_node_lock(an))
+    assert(0);
+
+  for (size_t j = 0; j < n;) {
+    unsigned char byte = bulk_key_byte(&e[j], pos);
+    size_t k = j + 1;
+    while (k < n && bulk_key_byte(&e[k], pos) == byte)
+      ++k;
+    if (ctx->tasks && k - j > 1 && k - j <= ctx->cutoff) {
+      ctx->tasks->push_back(art_bulk_task{an, byte, &e[j], k - j, pos + 1, nullptr, 0});
+    } else {
+      art_node *child = bulk_build(an, &e[j], k - j, pos + 1, ctx, local_bytes);
+      if (art_node_add_child(an, byte, child, 0))
+        assert(0);
+    }
+    j = k;
+  }
+  if (ctx->tasks)
+    ctx->top->push_back(an); // unlocked once the builders have attached their subtrees
+  else
+    art_node_unlock(an);
+  return an;
+}
+
+int adaptive_radix_tree_bulk_load(adaptive_radix_tree *art, const art_bulk_entry *entries, size_t n,
+                                  int threads)
+{
+  art_node *root;
+  __atomic_load(&art->root, &root, __ATOMIC_ACQUIRE);
+  if (root != 0)
+    return -1;
+  if (n == 0)
+    return 0;
+  for (size_t i = 1; i < n; ++i)
+    if (bulk_key_compare(&entries[i - 1], &entries[i]) > 0)
+      return -1;
+
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<art_bulk_task> tasks;
+  std::vector<art_node *> top;
+  art_bulk_context ctx;
+  // the placement is decided once, instead of per node as the budget fills up
+  ctx.local_depth = sidle::strategy_manager.get_threshold_manager()->get_local_allocation_layer_threshold();
+  // a few ranges per builder balance the uneven subtrees
+  ctx.cutoff = std::max(n / ((size_t)threads * 8), (size_t)1);
+  ctx.tasks = &tasks;
+  ctx.top = &top;
+  int64_t local_bytes = 0;
+  root = bulk_build(nullptr, entries, n, 0, &ctx, &local_bytes);
+
+  art_bulk_context sub = ctx;
+  sub.tasks = nullptr;
+  sub.top = nullptr;
+  std::atomic<size_t> next_task{0};
+  auto builder = [&]() {
+    size_t t;
+    while ((t = next_task.fetch_add(1, std::memory_order_relaxed)) < tasks.size()) {
+      art_bulk_task &task = tasks[t];
+      task.child = bulk_build(task.parent, task.entries, task.n, task.off, &sub, &task.local_bytes);
+    }
+  };
+  std::vector<std::thread> builders;
+  for (int i = 1; i < threads && (size_t)i < tasks.size(); ++i)
+    builders.emplace_back(builder);
+  builder();
+  for (auto &t : builders)
+    t.join();
+
+  for (auto &task : tasks) {
+    if (art_node_add_child(task.parent, task.byte, task.child, 0))
+      assert(0);
+    local_bytes += task.local_bytes;
+  }
+  for (art_node *an : top)
+    art_node_unlock(an);
+#if defined(CXL) && !defined(Allocator)
+  if (local_bytes)
+    sidle::strategy_manager.update_local_memory_usage(sidle::node_mem_type::local, LEAF_DEPTH, local_bytes);
+#endif
+  __atomic_store(&art->root, &root, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static inline int adaptive_radix_tree_leaf_match(art_node *an, const void *key, size_t len)
+{
+  return !art_leaf_tag_mismatch(an, key, len) && get_leaf_len(an) == len &&
+         memcmp(get_leaf_key(an), key, len) == 0;
+}
+
+// replace `an` by `new_` in its locked parent, or as the root if parent is 0, `new_` might be a leaf
+// require: an is locked
+static void adaptive_radix_tree_replace_node(art_node **root, art_node *parent, art_node *an, art_node *new_,
+                                             const void *key)
+{
+  if (likely(parent)) {
+    size_t off = art_node_version_get_offset(art_node_get_version_unsafe(an));
+    debug_assert_art(off);
+    art_node **slot = art_node_find_child(parent, art_node_get_version_unsafe(parent),
+                                          ((unsigned char *)key)[off - 1]);
+    debug_assert_art(slot && *slot == an);
+    __atomic_store(slot, &new_, __ATOMIC_RELEASE);
+    if (!is_leaf(new_))
+      art_node_set_parent_unsafe(new_, parent);
+    art_node_unlock(parent);
+  } else { // this is root
+    if (!is_leaf(new_))
+      art_node_set_parent_unsafe(new_, 0);
+    __atomic_store(root, &new_, __ATOMIC_RELEASE);
+  }
+}
+
+// return  0 on success,
+// return +1 on not found,
+// return -1 for retry
+static int _adaptive_radix_tree_remove(art_node **root, art_node *parent, art_node **ptr,
+  const void *key, size_t len, size_t off)
+{
+  art_node *an;
+  int first = 1;
+
+  begin:
+  if (first)  {
+    first = 0;
+  } else if (parent) {
+    // `ptr` is only valid as long as `parent` is not old
+    uint64_t pv = art_node_get_version(parent);
+    if (art_node_version_is_old(pv))
+      return -1; // return -1 so that we can retry from root
+  }
+
+  __atomic_load(ptr, &an, __ATOMIC_ACQUIRE);
+
+  if (unlikely(an == 0))
+    return parent ? -1 : 1; // slot emptied by another delete, or the art is empty
+
+  if (unlikely(is_leaf(an))) {
+    // a leaf below a node is removed together with its parent slot, getting here means
+    // a collapse moved the leaf up into a slot we descended through
+    if (parent)
+      return -1;
+    // art with only one leaf
+    if (!adaptive_radix_tree_leaf_match(an, key, len))
+      return 1;
+    // hold the value so that no update lands on the leaf after it is gone
+    leaf_node *leaf = get_leaf(reinterpret_cast<char*>(an));
+    if (unlikely(art_leaf_value_lock(leaf)))
+      return -1;
+    art_node *empty = 0;
+    if (likely(__atomic_compare_exchange_n(ptr, &an, empty, 0 /* weak */, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))) {
+      art_leaf_value_unlock(leaf, 1);
+      release_art_leaf(leaf);
       return 0;
-    // else another thread has replaced empty root
+    }
+    art_leaf_value_unlock(leaf, 0);
+    return -1;
   }
+
+  uint64_t v = art_node_get_stable_expand_version(an);
+  if (unlikely(art_node_version_get_offset(v) != off))
+    goto begin;
+  if (unlikely(art_node_version_is_old(v)))
+    goto begin;
+
+  int p = art_node_prefix_compare(an, v, key, len, off);
+
+  uint64_t v1 = art_node_get_version(an);
+  if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
+    goto begin;
+  v = v1;
+
+  if (p != art_node_version_get_prefix_len(v))
+    return 1;
+
+  size_t pos = off + p;
+  debug_assert_art(pos <= len);
+
+  int advance = pos != len;
+  unsigned char byte = advance ? ((unsigned char *)key)[pos] : 0;
+
+  art_node **next = art_node_find_child(an, v, byte);
+
+  v1 = art_node_get_version(an);
+  if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
+    goto begin;
+
+  if (next == 0)
+    return 1;
+
+  art_node *child;
+  __atomic_load(next, &child, __ATOMIC_ACQUIRE);
+  if (unlikely(child == 0))
+    goto begin;
+
+  if (!is_leaf(child))
+    return _adaptive_radix_tree_remove(root, an, next, key, len, pos + advance);
+
+  if (!adaptive_radix_tree_leaf_match(child, key, len))
+    return 1;
+
+  if (unlikely(art_node_lock(an)))
+    goto begin;
+
+  // the child might be moved or replaced before we acquire the lock
+  next = art_node_find_child(an, art_node_get_version_unsafe(an), byte);
+  if (unlikely(next == 0 || *next != child)) {
+    art_node_unlock(an);
+    goto begin;
+  }
+
+  leaf_node *leaf = get_leaf(reinterpret_cast<char*>(child));
+  // a leaf in the node cannot be moved while we hold the node, wait out the value writers
+  if (art_leaf_value_lock(leaf))
+    assert(0);
+  art_node_remove_child(an, byte);
+  art_leaf_value_unlock(leaf, 1);
+  release_art_leaf(leaf);
+
+  // a sparse node is replaced once its parent is held, if the parent is not found the node stays
+  // sparse until a later delete
+  art_node *locked_parent;
+  if (art_node_may_shrink(an) && !adaptive_radix_tree_lock_parent(root, an, key, len, &locked_parent)) {
+    art_node *new_ = art_node_shrink(an);
+    if (new_) {
+      adaptive_radix_tree_replace_node(root, locked_parent, an, new_, key);
+      if (!is_leaf(new_))
+        art_node_unlock(new_);
+    } else if (locked_parent) {
+      art_node_unlock(locked_parent);
+    }
+  }
+  art_node_unlock(an);
+  return 0;
+}
+
+// return 0 on success
+// return 1 on not found
+int adaptive_radix_tree_remove(adaptive_radix_tree *art, const void *key, size_t len)
+{
+  sidle::epoch_guard guard;
   int ret;
   // retry should be rare
-  while (unlikely((ret = _adaptive_radix_tree_put(0 /* parent */, &art->root, key, len, 0 /* off */)) == -1))
-    ;
+  while (unlikely((ret = _adaptive_radix_tree_remove(&art->root, 0 /* parent */, &art->root, key, len, 0 /* off */)) == -1))
+    adaptive_radix_tree_count_restart();
   return ret;
 }
 
@@ -273,10 +732,18 @@ static void* _adaptive_radix_tree_get(art_node *parent, art_node **ptr, const vo
     // we need to make sure that `ptr` is still valid because `parent` might changed
     uint64_t pv = art_node_get_version(parent);
     if (art_node_version_is_old(pv))
-      return (void *)1; // return 1 so that we can retry from root
+      return (void *)1; // return 1 so that the caller retries from the replacement of parent
     // `ptr` is still valid, we can proceed
   }
   __atomic_load(ptr, &an, __ATOMIC_ACQUIRE);
+  // slot emptied by a delete, or the art became empty
+  if (unlikely(an == 0))
+    return parent ? (void *)1 : 0;
+  // the tag of a leaf rejects another key without reading the leaf
+  if (is_leaf(an) && art_leaf_tag_mismatch(an, key, len))
+    return 0;
+  // charge the emulated remote cost of reading this node (no-op without emulation)
+  cxl_emulate_access(get_leaf(an), is_leaf(an) ? get_leaf_value_offset(get_leaf_len(an)) + sizeof(leaf_value) : 64);
 
   if (unlikely(is_leaf(an))) {
 #ifdef RECORD_ART_LEVEL
@@ -300,17 +767,22 @@ static void* _adaptive_radix_tree_get(art_node *parent, art_node **ptr, const vo
   }
 #endif
 
+  forward:
   uint64_t v = art_node_get_stable_expand_version(an);
-  if (unlikely(art_node_version_get_offset(v) != off))
+  if (unlikely(art_node_version_is_old(v))) {
+    // continue from the node that replaced it instead of from the root
+    if ((an = adaptive_radix_tree_forward(an)))
+      goto forward;
     goto begin;
-  if (unlikely(art_node_version_is_old(v)))
+  }
+  if (unlikely(art_node_version_get_offset(v) != off))
     goto begin;
 
   int p = art_node_prefix_compare(an, v, key, len, off);
 
   uint64_t v1 = art_node_get_version(an);
   if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
-    goto begin;
+    goto forward;
   v = v1;
 
   if (p != art_node_version_get_prefix_len(v))
@@ -326,15 +798,23 @@ static void* _adaptive_radix_tree_get(art_node *parent, art_node **ptr, const vo
 
   v1 = art_node_get_version(an);
 
-  if (unlikely(art_node_version_is_old(v1)))
-    goto begin;
+  // a delete moves children around under the expand bit
+  if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1))) {
+    off -= art_node_version_get_prefix_len(v);
+    goto forward;
+  }
 
   if (next) {
 #ifdef RECORD_ART_LEVEL
-    return _adaptive_radix_tree_get(an, next, key, len, off + advance, level + 1);
+    void *ret = _adaptive_radix_tree_get(an, next, key, len, off + advance, level + 1);
 #else
-    return _adaptive_radix_tree_get(an, next, key, len, off + advance);
+    void *ret = _adaptive_radix_tree_get(an, next, key, len, off + advance);
 #endif
+    if (likely((uint64_t)ret != 1))
+      return ret;
+    // the slot of the child went stale, find it again in this node or its replacement
+    off -= art_node_version_get_prefix_len(v);
+    goto forward;
   }
 
   // art_node_print(an);
@@ -344,14 +824,460 @@ static void* _adaptive_radix_tree_get(art_node *parent, art_node **ptr, const vo
 
 void* adaptive_radix_tree_get(adaptive_radix_tree *art, const void *key, size_t len)
 {
+  sidle::epoch_guard guard;
   void *ret;
   if (unlikely(art->root == 0))
     return 0;
   while (unlikely((uint64_t)(ret = _adaptive_radix_tree_get(0, &art->root, key, len, 0)) == 1))
-    ;
+    adaptive_radix_tree_count_restart();
   return ret;
 }
 
+// a lookup of adaptive_radix_tree_multi_get, advanced one node per step
+struct art_get_state
+{
+  const void *key;
+  size_t len;
+  size_t off;
+  art_node *parent;
+  art_node **ptr;
+  art_node *an; // the node or leaf loaded from ptr and prefetched, visited by the next step
+  size_t index; // the slot of the lookup in out
+};
+
+static inline void adaptive_radix_tree_prefetch(art_node *an)
+{
+  const char *p = (const char *)get_leaf(an);
+  __builtin_prefetch(p);
+  // the header and the first keys or the index of an inner node span two lines
+  if (!is_leaf(an))
+    __builtin_prefetch(p + 64);
+}
+
+static inline void multi_get_load(art_get_state *s)
+{
+  __atomic_load(s->ptr, &s->an, __ATOMIC_ACQUIRE);
+  if (likely(s->an != 0) && !(is_leaf(s->an) && art_leaf_tag_mismatch(s->an, s->key, s->len)))
+    adaptive_radix_tree_prefetch(s->an);
+}
+
+static inline void multi_get_start(art_get_state *s, art_node **root, const void *key, size_t len,
+                                   size_t index)
+{
+  s->key = key;
+  s->len = len;
+  s->off = 0;
+  s->parent = 0;
+  s->ptr = root;
+  s->index = index;
+  multi_get_load(s);
+}
+
+// the body of _adaptive_radix_tree_get for the prefetched node of a lookup, instead of descending
+// it loads and prefetches the next node and yields to the other lookups
+// return 1 once the lookup is done and its leaf, or 0, is in out
+static int multi_get_step(art_get_state *s, art_node **root, leaf_node **out)
+{
+  art_node *an = s->an;
+  if (unlikely(an == 0)) {
+    // slot emptied by a delete, or the art became empty
+    if (s->parent)
+      goto restart;
+    out[s->index] = 0;
+    return 1;
+  }
+  if (is_leaf(an) && art_leaf_tag_mismatch(an, s->key, s->len)) {
+    out[s->index] = 0;
+    return 1;
+  }
+  cxl_emulate_access(get_leaf(an), is_leaf(an) ? get_leaf_value_offset(get_leaf_len(an)) + sizeof(leaf_value) : 64);
+
+  if (unlikely(is_leaf(an))) {
+    const char *k1 = get_leaf_key(an), *k2 = (const char *)s->key;
+    size_t l1 = get_leaf_len(an), l2 = s->len, i;
+    for (i = s->off; i < l1 && i < l2 && k1[i] == k2[i]; ++i)
+      ;
+    if (i == l1 && i == l2) {
+      leaf_node *leaf = get_leaf(reinterpret_cast<char*>(an));
+      sidle::update_access<leaf_node>(leaf);
+      out[s->index] = leaf;
+    } else {
+      out[s->index] = 0;
+    }
+    return 1;
+  }
+
+  {
+    uint64_t v = art_node_get_stable_expand_version(an);
+    if (unlikely(art_node_version_get_offset(v) != s->off || art_node_version_is_old(v)))
+      goto retry;
+
+    int p = art_node_prefix_compare(an, v, s->key, s->len, s->off);
+
+    uint64_t v1 = art_node_get_version(an);
+    if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
+      goto retry;
+    v = v1;
+
+    if (p != art_node_version_get_prefix_len(v)) {
+      out[s->index] = 0;
+      return 1;
+    }
+
+    size_t off = s->off + art_node_version_get_prefix_len(v);
+    debug_assert_art(off <= s->len);
+    int advance = off != s->len;
+    unsigned char byte = advance ? ((unsigned char *)s->key)[off] : 0;
+
+    art_node **next = art_node_find_child(an, v, byte);
+
+    v1 = art_node_get_version(an);
+    if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
+      goto retry;
+
+    if (!next) {
+      out[s->index] = 0;
+      return 1;
+    }
+    s->parent = an;
+    s->ptr = next;
+    s->off = off + advance;
+    multi_get_load(s);
+    return 0;
+  }
+
+  retry:
+  if (art_node_version_is_old(art_node_get_version(an)) && (s->an = adaptive_radix_tree_forward(an))) {
+    adaptive_radix_tree_prefetch(s->an);
+    return 0;
+  }
+  // `ptr` is only valid while `parent` is not old
+  if (!s->parent || !art_node_version_is_old(art_node_get_version(s->parent))) {
+    multi_get_load(s);
+    return 0;
+  }
+  restart:
+  adaptive_radix_tree_count_restart();
+  s->off = 0;
+  s->parent = 0;
+  s->ptr = root;
+  multi_get_load(s);
+  return 0;
+}
+
+size_t adaptive_radix_tree_multi_get(adaptive_radix_tree *art, const void *const *keys, const size_t *lens,
+                                     size_t n, leaf_node **out)
+{
+  sidle::epoch_guard guard;
+  art_get_state group[art_multi_get_group];
+  size_t next = 0, active = 0, found = 0;
+  for (; active < art_multi_get_group && next < n; ++active, ++next)
+    multi_get_start(&group[active], &art->root, keys[next], lens[next], next);
+
+  // round robin over the lookups, the node a lookup waits for is fetched while the others run
+  while (active) {
+    for (size_t i = 0; i < active;) {
+      art_get_state *s = &group[i];
+      if (!multi_get_step(s, &art->root, out)) {
+        ++i;
+        continue;
+      }
+      found += out[s->index] != 0;
+      if (next < n) {
+        multi_get_start(s, &art->root, keys[next], lens[next], next);
+        ++next;
+        ++i;
+      } else {
+        *s = group[--active];
+      }
+    }
+  }
+  return found;
+}
+
+static inline leaf_node* adaptive_radix_tree_get_leaf(adaptive_radix_tree *art, const void *key, size_t len)
+{
+  void *k = adaptive_radix_tree_get(art, key, len);
+  return k ? (leaf_node *)((char *)k - offsetof(leaf_node, key)) : 0;
+}
+
+// return the length of the value, -1 on not found
+int64_t adaptive_radix_tree_get_value(adaptive_radix_tree *art, const void *key, size_t len,
+  void *buf, size_t cap)
+{
+  sidle::epoch_guard guard;
+  while (1) {
+    leaf_node *leaf = adaptive_radix_tree_get_leaf(art, key, len);
+    if (leaf == 0)
+      return -1;
+    int64_t ret = art_leaf_read_value(leaf, buf, cap);
+    // a leaf moved meanwhile might miss the latest update
+    if (likely(!art_leaf_value_is_moved(leaf)))
+      return ret;
+  }
+}
+
+// return 0 on success
+// return 1 on not found
+int adaptive_radix_tree_update(adaptive_radix_tree *art, const void *key, size_t len,
+  const void *value, size_t value_len)
+{
+  sidle::epoch_guard guard;
+  while (1) {
+    leaf_node *leaf = adaptive_radix_tree_get_leaf(art, key, len);
+    if (leaf == 0)
+      return 1;
+    if (unlikely(art_leaf_value_lock(leaf)))
+      continue; // leaf has been migrated or removed
+    art_leaf_write_value(leaf, value, value_len);
+    art_leaf_value_unlock(leaf, 0);
+    return 0;
+  }
+}
+
+// return 0 on success
+// return 1 on not found
+// return 2 if the value differs from expected
+int adaptive_radix_tree_compare_and_swap(adaptive_radix_tree *art, const void *key, size_t len,
+  const void *expected, size_t expected_len, const void *desired, size_t desired_len)
+{
+  sidle::epoch_guard guard;
+  while (1) {
+    leaf_node *leaf = adaptive_radix_tree_get_leaf(art, key, len);
+    if (leaf == 0)
+      return 1;
+    if (unlikely(art_leaf_value_lock(leaf)))
+      continue; // leaf has been migrated or removed
+    int equal = art_leaf_value_equal(leaf, expected, expected_len);
+    if (equal)
+      art_leaf_write_value(leaf, desired, desired_len);
+    art_leaf_value_unlock(leaf, 0);
+    return equal ? 0 : 2;
+  }
+}
+
+struct art_scan_state
+{
+  const unsigned char *start;
+  size_t start_len;
+  int exclusive;
+  const unsigned char *upper;
+  size_t upper_len;
+  int past_upper;
+  leaf_node **out;
+  int count, max;
+};
+
+static int art_leaf_compare(leaf_node *leaf, const void *key, size_t len)
+{
+  size_t l = leaf->key_length < len ? leaf->key_length : len;
+  int cmp = memcmp(leaf->key, key, l);
+  if (cmp)
+    return cmp;
+  return leaf->key_length < len ? -1 : leaf->key_length > len;
+}
+
+// collect a leaf unless it is before the start key, return 1 when the scan should stop
+static int art_scan_emit(art_scan_state *s, art_node *child, int bound)
+{
+  leaf_node *leaf = get_leaf(child);
+  cxl_emulate_access(leaf, sizeof(leaf_node) + leaf->key_length);
+  if (bound) {
+    int cmp = art_leaf_compare(leaf, s->start, s->start_len);
+    if (cmp < 0 || (cmp == 0 && s->exclusive))
+      return 0;
+  }
+  if (s->upper && art_leaf_compare(leaf, s->upper, s->upper_len) > 0) {
+    s->past_upper = 1;
+    return 1;
+  }
+  s->out[s->count++] = leaf;
+  return s->count == s->max;
+}
+
+// collect the leaves below `an` in key order, `bound` tells whether `an` is on the path of the
+// start key, where smaller keys have to be skipped
+// return  0 when the subtree is exhausted,
+// return +1 when the scan should stop,
+// return -1 for restart
+static int _adaptive_radix_tree_scan(art_node *an, size_t off, int bound, art_scan_state *s)
+{
+  cxl_emulate_access(an, 64);
+
+  uint64_t v = art_node_get_stable_expand_version(an);
+  if (unlikely(art_node_version_is_old(v) || art_node_version_get_offset(v) != off))
+    return -1;
+
+  int prefix_len = art_node_version_get_prefix_len(v);
+  size_t pos = off + prefix_len;
+  int byte = 0, skip = 0;
+  if (bound) {
+    int i = art_node_prefix_compare(an, v, s->start, s->start_len, off);
+    if (i < prefix_len) {
+      // the prefix leaves the start key, every key below is either smaller or larger
+      skip = off + i < s->start_len && (unsigned char)an->prefix[i] < s->start[off + i];
+      bound = 0;
+    } else if (pos < s->start_len) {
+      byte = s->start[pos];
+    }
+  }
+
+  uint64_t v1 = art_node_get_version(an);
+  if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1)))
+    return -1;
+  if (skip)
+    return 0;
+
+  unsigned char found, next_found = 0;
+  art_node **slot = art_node_next_child(an, v, byte, &found);
+  while (slot) {
+    art_node *child;
+    __atomic_load(slot, &child, __ATOMIC_ACQUIRE);
+    // look one child ahead, so the next sibling, most likely on CXL, is on its way while we descend
+    art_node **next = found < 255 ? art_node_next_child(an, v, found + 1, &next_found) : 0;
+    if (next) {
+      art_node *sibling;
+      __atomic_load(next, &sibling, __ATOMIC_RELAXED);
+      if (sibling)
+        sidle::prefetch_node(get_leaf(sibling), 64);
+    }
+
+    // a delete moves children around under the expand bit
+    v1 = art_node_get_version(an);
+    if (unlikely(art_node_version_is_old(v1) || art_node_version_compare_expand(v, v1) || child == 0))
+      return -1;
+
+    int ret;
+    if (is_leaf(child))
+      ret = art_scan_emit(s, child, bound);
+    else
+      ret = _adaptive_radix_tree_scan(child, pos + 1,
+                                      bound && pos < s->start_len && found == s->start[pos], s);
+    if (ret)
+      return ret;
+    slot = next;
+    found = next_found;
+  }
+  return 0;
+}
+
+// collect the next batch of leaves after the iterator's key
+static void art_iterator_fill(art_iterator *it)
+{
+  art_scan_state s = {it->key, it->len, it->exclusive, it->upper, it->upper_len, 0,
+                      it->batch, 0, art_iterator_batch};
+  int ret;
+  do {
+    art_node *root;
+    __atomic_load(&it->art->root, &root, __ATOMIC_ACQUIRE);
+    if (unlikely(root == 0))
+      ret = 0;
+    else if (unlikely(is_leaf(root)))
+      ret = art_scan_emit(&s, root, 1);
+    else
+      ret = _adaptive_radix_tree_scan(root, 0, 1, &s);
+    // the leaves collected before a restart are still in order, keep them and go on from the last
+  } while (unlikely(ret == -1 && s.count == 0));
+
+  it->pos = 0;
+  it->count = s.count;
+  it->end = ret == 0 || s.past_upper;
+  if (s.count) {
+    leaf_node *last = s.out[s.count - 1];
+    it->len = last->key_length;
+    memcpy(it->key, last->key, it->len);
+    it->exclusive = 1;
+  }
+}
+
+void art_iterator_init(art_iterator *it, adaptive_radix_tree *art)
+{
+  // the leaves handed out stay valid until the iterator ends or is closed
+  sidle::node_epoch.enter();
+  it->held = 1;
+  it->art = art;
+  it->pos = it->count = 0;
+  it->exclusive = 0;
+  it->end = 0;
+  it->upper = 0;
+  it->upper_len = 0;
+  it->len = 0;
+}
+
+void art_iterator_seek(art_iterator *it, const void *key, size_t len)
+{
+  assert(len <= sizeof(it->key));
+  memcpy(it->key, key, len);
+  it->len = len;
+  it->exclusive = 0;
+  it->pos = it->count = 0;
+  it->end = 0;
+}
+
+void art_iterator_set_upper(art_iterator *it, const void *key, size_t len)
+{
+  it->upper = (const unsigned char *)key;
+  it->upper_len = len;
+}
+
+leaf_node* art_iterator_next(art_iterator *it)
+{
+  if (it->pos == it->count) {
+    if (!it->end)
+      art_iterator_fill(it);
+    if (it->pos == it->count) {
+      art_iterator_close(it);
+      return 0;
+    }
+  }
+  return it->batch[it->pos++];
+}
+
+void art_iterator_close(art_iterator *it)
+{
+  if (it->held) {
+    it->held = 0;
+    sidle::node_epoch.exit();
+  }
+}
+
+size_t adaptive_radix_tree_range_scan(adaptive_radix_tree *art, const void *start, size_t start_len,
+                                      const void *end, size_t end_len, leaf_callback cb)
+{
+  art_iterator it;
+  art_iterator_init(&it, art);
+  art_iterator_seek(&it, start, start_len);
+  art_iterator_set_upper(&it, end, end_len);
+  size_t n = 0;
+  leaf_node *leaf;
+  while ((leaf = art_iterator_next(&it))) {
+    ++n;
+    if (!cb(leaf))
+      break;
+  }
+  art_iterator_close(&it);
+  return n;
+}
+
+size_t adaptive_radix_tree_prefix_scan(adaptive_radix_tree *art, const void *prefix, size_t len,
+                                       leaf_callback cb)
+{
+  art_iterator it;
+  art_iterator_init(&it, art);
+  art_iterator_seek(&it, prefix, len);
+  size_t n = 0;
+  leaf_node *leaf;
+  while ((leaf = art_iterator_next(&it))) {
+    if (leaf->key_length < len || memcmp(leaf->key, prefix, len))
+      break;
+    ++n;
+    if (!cb(leaf))
+      break;
+  }
+  art_iterator_close(&it);
+  return n;
+}
+
 bool _adaptive_radix_tree_traverse(art_node *parent, art_node *node, art_callback cb, 
                                    bool full = false) {
   // check whether the node is up-to-date
@@ -363,6 +1289,10 @@ bool _adaptive_radix_tree_traverse(art_node *parent, art_node *node, art_callbac
     return true;
   };
 
+  // a slot emptied by a concurrent delete
+  if (unlikely(node == nullptr)) {
+    return true;
+  }
   if (is_leaf(node)) {
     cb(parent, get_leaf(reinterpret_cast<char*>(node)));
     return true;
@@ -450,6 +1380,7 @@ bool _adaptive_radix_tree_traverse(art_node *parent, art_node *node, art_callbac
 }
 
 void adaptive_radix_tree_traverse(adaptive_radix_tree *art, art_callback cb) {
+  sidle::epoch_guard guard;
   if (unlikely(art->root == 0)) {
     return;
   }
@@ -458,37 +1389,74 @@ void adaptive_radix_tree_traverse(adaptive_radix_tree *art, art_callback cb) {
   _adaptive_radix_tree_traverse(nullptr, art->root, cb);
 }
 
-// traverse the tree in multi-thread
-bool _adaptive_radix_tree_traverse_mt(art_node *parent, art_node *node, art_callback cb) {
+// traverse a subtree on a worker of pool, a child is split off as a task while a worker is idle
+// and walked in place otherwise
+static bool _adaptive_radix_tree_traverse_mt(sidle::traverse_pool &pool, int worker, art_node *parent,
+                                             art_node *node, art_callback &cb);
+
+// a subtree split off by _adaptive_radix_tree_traverse_mt, arg0 is the parent and arg1 the slot
+// of the child, re-read on a retry like the single-threaded traverse does
+static void adaptive_radix_tree_traverse_task(sidle::traverse_pool &pool, const sidle::traverse_task &task,
+                                              int worker) {
+  art_callback &cb = *static_cast<art_callback*>(task.ctx);
+  art_node *parent = static_cast<art_node*>(task.arg0);
+  art_node **slot = static_cast<art_node**>(task.arg1);
+  while (!_adaptive_radix_tree_traverse_mt(pool, worker, parent, *slot, cb)) {
+    if (art_node_version_is_old(art_node_get_version(parent))) {
+      return;
+    }
+  }
+}
+
+static bool _adaptive_radix_tree_traverse_mt(sidle::traverse_pool &pool, int worker, art_node *parent,
+                                             art_node *node, art_callback &cb) {
+  auto is_valid_node = [](art_node *node) {
+    return !art_node_version_is_old(art_node_get_version(node));
+  };
+  // walk or split off the child in slot, false if node is replaced meanwhile
+  auto visit = [&](art_node **slot) {
+    if (pool.should_split(worker)) {
+      pool.spawn(worker, {adaptive_radix_tree_traverse_task, &cb, node, slot});
+      return true;
+    }
+    while (!_adaptive_radix_tree_traverse_mt(pool, worker, node, *slot, cb)) {
+      if (!is_valid_node(node)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // a slot emptied by a concurrent delete
+  if (unlikely(node == nullptr)) {
+    return true;
+  }
   if (is_leaf(node)) {
     cb(parent, get_leaf(reinterpret_cast<char*>(node)));
     return true;
   }
-  uint64_t v = art_node_get_stable_expand_version(node);
-  if (art_node_version_is_old(v)) {
+  if (!is_valid_node(node)) {
     return false;
   }
-  std::vector<std::future<bool>> results;
-  int child_count = 0;
-  switch (get_node_type(v))
-  {
+  uint64_t v = art_node_get_stable_expand_version(node);
+  switch (get_node_type(v)) {
   case node4: {
-    child_count = get_count(node->version);
+    int child_count = get_count(node->version);
     art_node4 *n4 = reinterpret_cast<art_node4*>(node);
     for (int i = 0; i < child_count; ++i) {
-      results.emplace_back(pool->enqueue([=] {
-        return _adaptive_radix_tree_traverse(node, n4->child[i], cb);
-      }));
+      if (!is_valid_node(node) || !visit(&n4->child[i])) {
+        return false;
+      }
     }
     break;
   }
   case node16: {
-    child_count = get_count(node->version);
+    int child_count = get_count(node->version);
     art_node16 *n16 = reinterpret_cast<art_node16*>(node);
     for (int i = 0; i < child_count; ++i) {
-      results.emplace_back(pool->enqueue([=] {
-        return _adaptive_radix_tree_traverse(node, n16->child[i], cb);
-      }));
+      if (!is_valid_node(node) || !visit(&n16->child[i])) {
+        return false;
+      }
     }
     break;
   }
@@ -496,10 +1464,8 @@ bool _adaptive_radix_tree_traverse_mt(art_node *parent, art_node *node, art_call
     art_node48 *n48 = reinterpret_cast<art_node48*>(node);
     for (int i = 0; i < 256; ++i) {
       char index = n48->index[i];
-      if (index) {
-        results.emplace_back(pool->enqueue([=] {
-          return _adaptive_radix_tree_traverse(node, n48->child[index - 1], cb);
-        }));
+      if (index && (!is_valid_node(node) || !visit(&n48->child[index - 1]))) {
+        return false;
       }
     }
     break;
@@ -507,40 +1473,36 @@ bool _adaptive_radix_tree_traverse_mt(art_node *parent, art_node *node, art_call
   case node256: {
     art_node256 *n256 = reinterpret_cast<art_node256*>(node);
     for (int i = 0; i < 256; ++i) {
-      if (n256->child[i]) {
-        results.emplace_back(pool->enqueue([=] {
-          return _adaptive_radix_tree_traverse(node, n256->child[i], cb);
-        }));
+      if (n256->child[i] && (!is_valid_node(node) || !visit(&n256->child[i]))) {
+        return false;
       }
     }
     break;
   }
   default:
-    break;
-  }
-  bool final_result = true;
-  for (auto &&result : results) {
-    final_result &= result.get();
+    throw std::runtime_error("encounter invalid node type when traversing");
   }
-  return final_result;
+  return true;
 }
 
 void adaptive_radix_tree_traverse_mt(adaptive_radix_tree *art, art_callback cb) {
+  // the workers read the nodes split off by the others under the critical section of the caller
+  sidle::epoch_guard guard;
   if (unlikely(art->root == 0)) {
     return;
   }
   /// @note it is @b best-effort traverse, if cannot traverse the whole tree 
   // because of inconsistency, not retry
-  _adaptive_radix_tree_traverse_mt(nullptr, art->root, cb);
-}
-
-void init_thread_pool(int start_tid) {
-  pool = new ThreadPool(4, start_tid);
+  sidle::traverse_task root = {[](sidle::traverse_pool &pool, const sidle::traverse_task &task, int worker) {
+    _adaptive_radix_tree_traverse_mt(pool, worker, nullptr, static_cast<art_node*>(task.arg0),
+                                     *static_cast<art_callback*>(task.ctx));
+  }, &cb, art->root, nullptr};
+  sidle::traverse_workers.run(&root, 1);
 }
 
+/// @return the slot of old_child in parent, nullptr if it is not a child of parent
 /// @pre the @param parent node has already been locked
-void replace_old_child_ptr(art_node* parent, const art_node* old_child, 
-                          art_node* new_child) {
+static art_node** find_old_child_slot(art_node* parent, const art_node* old_child) {
   SIDLE_CHECK(parent != nullptr, "[DEBUG] parent node shouldn't be empty");
   int child_count = get_count(parent->version);
   switch (get_node_type(parent->version)) {
@@ -548,8 +1510,7 @@ void replace_old_child_ptr(art_node* parent, const art_node* old_child,
     art_node4* p4 = reinterpret_cast<art_node4*>(parent);
     for (int i = 0; i < child_count; ++i) {
       if (p4->child[i] == old_child) {
-        p4->child[i] = new_child;
-        break;
+        return &p4->child[i];
       }
     }
     break;
@@ -558,8 +1519,7 @@ void replace_old_child_ptr(art_node* parent, const art_node* old_child,
     art_node16* p16 = reinterpret_cast<art_node16*>(parent);
     for (int i = 0; i < child_count; ++i) {
       if (p16->child[i] == old_child) {
-        p16->child[i] = new_child;
-        break;
+        return &p16->child[i];
       }
     }
     break;
@@ -567,10 +1527,9 @@ void replace_old_child_ptr(art_node* parent, const art_node* old_child,
   case node48: {
     art_node48* p48 = reinterpret_cast<art_node48*>(parent);
     for (int i = 0; i < 256; ++i) {
-      char index = p48->index[i];
+      unsigned char index = p48->index[i];
       if (index && p48->child[index - 1] == old_child) {
-        p48->child[index - 1] = new_child;
-        break;
+        return &p48->child[index - 1];
       }
     }
     break;
@@ -579,13 +1538,22 @@ void replace_old_child_ptr(art_node* parent, const art_node* old_child,
     art_node256* p256 = reinterpret_cast<art_node256*>(parent);
     for (int i = 0; i < 256; ++i) {
       if (p256->child[i] == old_child) {
-        p256->child[i] = new_child;
-        break;
+        return &p256->child[i];
       }
     }
     break;
   }
   }
+  return nullptr;
+}
+
+/// @pre the @param parent node has already been locked
+void replace_old_child_ptr(art_node* parent, const art_node* old_child, 
+                          art_node* new_child) {
+  art_node** slot = find_old_child_slot(parent, old_child);
+  if (slot != nullptr) {
+    __atomic_store_n(slot, new_child, __ATOMIC_RELEASE);
+  }
 }
 
 /// @brief get the child pointers of the current node
@@ -631,14 +1599,121 @@ void replace_old_parent_ptr(art_node* cur_node) {
   });
 }
 
+/// @brief the longest key a migration worker keeps to find the parents of the next nodes it moves
+constexpr size_t migration_key_capacity = 64;
+
+/// @brief a key below the node a migration worker moved last. A migration goes on with the
+/// parent of the node it moved, which is found along the same key without parent pointers.
+struct migration_key {
+  size_t len{0};
+  unsigned char key[migration_key_capacity];
+};
+
+static thread_local migration_key last_migration_key;
+
+static inline void remember_migration_key(const void* key, size_t len) {
+  if (len <= migration_key_capacity) {
+    memcpy(last_migration_key.key, key, len);
+    last_migration_key.len = len;
+  } else {
+    last_migration_key.len = 0;
+  }
+}
+
+/// @return the leaf below an inner node reached through the first children, nullptr if the
+/// node has no children left
+static leaf_node* find_first_leaf(art_node* an) {
+  while (true) {
+    unsigned char found;
+    art_node** slot = art_node_next_child(an, art_node_get_version(an), 0, &found);
+    if (slot == nullptr) {
+      return nullptr;
+    }
+    art_node* child;
+    __atomic_load(slot, &child, __ATOMIC_ACQUIRE);
+    if (child == nullptr) {
+      return nullptr;
+    }
+    if (is_leaf(child)) {
+      return get_leaf(reinterpret_cast<char*>(child));
+    }
+    an = child;
+  }
+}
+
+/// @brief find the parent of an inner node without parent pointers, along the key of the last
+/// migration or else along the key of a leaf below the node
+/// @return the slot of the node, nullptr if it is not in the tree anymore
+static art_node** find_parent_slot(adaptive_radix_tree* art, art_node* an, art_node** parent) {
+  art_node** slot = nullptr;
+  if (last_migration_key.len > 0) {
+    slot = adaptive_radix_tree_descend_to(&art->root, an, last_migration_key.key,
+                                          last_migration_key.len, parent);
+  }
+  if (slot == nullptr) {
+    leaf_node* leaf = find_first_leaf(an);
+    if (leaf == nullptr) {
+      return nullptr;
+    }
+    remember_migration_key(leaf->key, leaf->key_length);
+    slot = adaptive_radix_tree_descend_to(&art->root, an, leaf->key, leaf->key_length, parent);
+  }
+  return slot;
+}
+
+art_node* get_art_parent(adaptive_radix_tree* art, art_node* an) {
+  if (art_parent_ptrs) {
+    return an->parent;
+  }
+  art_node* parent = nullptr;
+  return find_parent_slot(art, an, &parent) != nullptr ? parent : nullptr;
+}
+
+/// @brief lock the parent of a node about to be migrated
+/// @pre the node is locked
+/// @return the locked parent, nullptr if the node is the root or could not be found
+static art_node* lock_migration_parent(adaptive_radix_tree* art, art_node* an) {
+  if (art_parent_ptrs) {
+    if (unlikely(!IS_VALID_ADDR(reinterpret_cast<uint64_t>(an->parent)))) {
+      fprintf(stderr, "node %p's parent addr is invalid %p\n", an, an->parent);
+      return nullptr;
+    }
+    return art::art_node_get_locked_parent(an);
+  }
+  // a node is only moved out of its parent by a writer holding the node, so a failed lookup is
+  // a writer changing the path above it and the lookup is repeated
+  for (int attempt = 0; attempt < 8; ++attempt) {
+    art_node* parent = nullptr;
+    art_node** slot = find_parent_slot(art, an, &parent);
+    if (slot == nullptr) {
+      continue;
+    }
+    if (parent == nullptr) {
+      // the root
+      return nullptr;
+    }
+    if (unlikely(art::art_node_lock(parent))) {
+      continue;
+    }
+    art_node* child;
+    __atomic_load(slot, &child, __ATOMIC_ACQUIRE);
+    if (likely(child == an)) {
+      return parent;
+    }
+    art::art_node_unlock(parent);
+  }
+  return nullptr;
+}
 
 art_node* leaf_migration(leaf_node* cur_node, art_node* parent, sidle::node_mem_type target_type) {
   if (unlikely(!cur_node)) {
     return nullptr;
   }
 
-  // check whether current node has already been migrated
-  if (unlikely(cur_node->sidle_meta.metadata.type == target_type)) {
+  // check whether current node has already been migrated, unless the compactor relocates it
+  // out of a chunk under evacuation
+  bool relocation = cur_node->sidle_meta.metadata.type == target_type;
+  if (unlikely(relocation && !sidle::node_allocator.evacuating(target_type, cur_node))) {
     return nullptr;
   }
   
@@ -660,23 +1735,42 @@ art_node* leaf_migration(leaf_node* cur_node, art_node* parent, sidle::node_mem_
   //   cur_node, target_type == node_mem_type::local ? "local" : "remote", 
   //   parent, cur_node->sidle_meta.metadata.depth, parent->sidle_meta.depth);
 
-  uintptr_t new_node_ptr = art::alloc_leaf(parent, cur_node->key,
-                                          cur_node->key_length, target_type, 
-                                          true);
+  // hold the value while it is copied, a leaf removed or moved meanwhile is left alone
+  if (unlikely(art::art_leaf_value_lock(cur_node))) {
+    art::art_node_unlock(parent);
+    return nullptr;
+  }
+  // an insert may have pushed the leaf down into a new node since it was queued
+  art_node** slot = find_old_child_slot(parent,
+      reinterpret_cast<art_node*>(make_tagged_leaf(cur_node, cur_node->sidle_meta.get_type())));
+  if (unlikely(slot == nullptr)) {
+    art::art_leaf_value_unlock(cur_node, 0);
+    art::art_node_unlock(parent);
+    return nullptr;
+  }
+  size_t leaf_size = get_leaf_size(cur_node);
+  uintptr_t new_node_ptr = art::alloc_leaf_copy(parent, cur_node, target_type);
   leaf_node* new_node = get_leaf(reinterpret_cast<char*>(new_node_ptr));
-  new_node->sidle_meta = cur_node->sidle_meta;
   new_node->sidle_meta.metadata.type = target_type;
-  if (!parent) {
-    throw std::runtime_error("the root node should not be migrated");
-  }
   // replace the old leaf node pointer with the new one
-  replace_old_child_ptr(parent, reinterpret_cast<art_node*>(make_leaf(cur_node)),
-                        reinterpret_cast<art_node*>(new_node_ptr));
+  __atomic_store_n(slot, reinterpret_cast<art_node*>(new_node_ptr), __ATOMIC_RELEASE);
+  if (relocation) {
+    // the new copy was charged to the tier, the old one leaves it
+    sidle::strategy_manager.update_local_memory_usage(target_type, cur_node->sidle_meta.metadata.depth,
+        -static_cast<int64_t>(leaf_size));
+  }
+  art::art_leaf_value_unlock(cur_node, 1);
+  if (!art_parent_ptrs) {
+    // the migration may go on with the ancestors of the leaf
+    remember_migration_key(new_node->key, new_node->key_length);
+  }
+  retire_art_leaf(cur_node);
 
   return parent;
 }
 
-art_node* internode_migration(art_node* original_node, sidle::node_mem_type target_type, bool need_lock_first) {
+art_node* internode_migration(art_node* original_node, sidle::node_mem_type target_type, bool need_lock_first,
+                              adaptive_radix_tree* art) {
   using namespace sidle;
   if (need_lock_first) {
     // lock the node
@@ -700,13 +1794,12 @@ art_node* internode_migration(art_node* original_node, sidle::node_mem_type targ
     return nullptr;
   }
 
-  if (unlikely(!IS_VALID_ADDR(reinterpret_cast<uint64_t>(original_node->parent)))) {
-    fprintf(stderr, "node %p's parent addr is invalid %p\n", original_node,
-            original_node->parent);
+  if (unlikely(original_node->sidle_meta.depth == 1)) {
     art::art_node_unlock(original_node);
     return nullptr;
   }
-  if (unlikely(original_node->sidle_meta.depth == 1)) {
+  art_node* parent = lock_migration_parent(art, original_node);
+  if (unlikely(parent == nullptr)) {
     art::art_node_unlock(original_node);
     return nullptr;
   }
@@ -728,21 +1821,26 @@ art_node* internode_migration(art_node* original_node, sidle::node_mem_type targ
     throw std::runtime_error("[migrate_internode] invalid node type");
   }
   art_node* new_node = art::_new_art_node(new_node_size, nullptr, 0, target_type, true);
-  memcpy(new_node, original_node, new_node_size);
+  sidle::copy_node(new_node, original_node, new_node_size, target_type);
+  if (original_node->sidle_meta.type == target_type) {
+    // relocated by the compactor, the new copy was charged to the tier and the old one leaves it
+    sidle::strategy_manager.update_local_memory_usage(target_type, original_node->sidle_meta.depth,
+                                                      -static_cast<int64_t>(new_node_size));
+  }
   new_node->sidle_meta.type = target_type;
-  art_node* parent = art::art_node_get_locked_parent(original_node);
-  SIDLE_CHECK(parent != nullptr,
-          "[migrate_internode] the parent node shouldn't be empty");
   
   // replace the old child pointer with the new one
   replace_old_child_ptr(parent, original_node, new_node);
   
-  // change the original node's chidren's parent pointer
-  replace_old_parent_ptr(new_node);
+  // change the original node's chidren's parent pointer, without parent pointers the move is done
+  if (art_parent_ptrs) {
+    replace_old_parent_ptr(new_node);
+  }
 
   // update the new node information and mark the original node as deleted
   art::art_node_set_new_node(original_node, new_node);
   art::art_node_set_version(original_node, set_old(v));
+  art::retire_art_node(original_node);
   art::art_node_unlock(original_node);
   art::art_node_unlock(new_node);
   return parent;
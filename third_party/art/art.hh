@@ -20,23 +20,80 @@ namespace art {
 
 art_node* _new_art_node(size_t size, art_node* parent, size_t old_size,
                           sidle::node_mem_type target_type, 
-                          bool is_migration = false);
+                          bool is_migration = false, uint8_t depth = 0);
 uint64_t art_node_get_version(art_node *an);
 adaptive_radix_tree* new_adaptive_radix_tree(int cxl_percentage,
                                             uint64_t local_memory_amount = 110);
 void free_adaptive_radix_tree(adaptive_radix_tree *art);
-int adaptive_radix_tree_put(adaptive_radix_tree *art, const void *key, size_t len);
+/// @brief insert key with its value, an existing key gets its value overwritten in place
+/// @return 0 on insert, 1 if the key exists
+int adaptive_radix_tree_put(adaptive_radix_tree *art, const void *key, size_t len,
+                            const void *value = nullptr, size_t value_len = 0);
+/// @brief build the tree from entries sorted by key, one subtree per thread. Each node gets the
+///        smallest type holding its children, the levels up to the local allocation threshold
+///        are placed in local memory and the rest in CXL, like a put would place them.
+/// @param threads the builders, 0 for the hardware concurrency
+/// @return 0 on success, -1 if the tree is not empty or entries are not sorted
+/// @note keys follow the rules of adaptive_radix_tree_put, the last of equal keys wins, and the
+///       tree must not be accessed until the load returns
+int adaptive_radix_tree_bulk_load(adaptive_radix_tree *art, const art_bulk_entry *entries, size_t n,
+                                  int threads = 0);
+/// @return the key in the leaf, only valid while the caller holds a sidle::epoch_guard
 void* adaptive_radix_tree_get(adaptive_radix_tree *art, const void *key, size_t len);
+/// @brief look up n keys at once, interleaving the lookups so the CXL latency of one node is
+///        hidden behind the work on the others
+/// @param out the leaf of each key or nullptr, only valid while the caller holds a sidle::epoch_guard
+/// @return the number of keys found
+size_t adaptive_radix_tree_multi_get(adaptive_radix_tree *art, const void *const *keys, const size_t *lens,
+                                     size_t n, leaf_node **out);
+/// @brief copy at most cap bytes of the value of key to buf
+/// @return the length of the value, -1 if key is absent
+int64_t adaptive_radix_tree_get_value(adaptive_radix_tree *art, const void *key, size_t len,
+                                      void *buf, size_t cap);
+/// @brief overwrite the value of key without reallocating its leaf
+/// @return 0 on success, 1 if key is absent
+int adaptive_radix_tree_update(adaptive_radix_tree *art, const void *key, size_t len,
+                               const void *value, size_t value_len);
+/// @brief replace the value of key by desired if it equals expected
+/// @return 0 on success, 1 if key is absent, 2 if the value differs from expected
+int adaptive_radix_tree_compare_and_swap(adaptive_radix_tree *art, const void *key, size_t len,
+                                         const void *expected, size_t expected_len,
+                                         const void *desired, size_t desired_len);
+int adaptive_radix_tree_remove(adaptive_radix_tree *art, const void *key, size_t len);
+void art_iterator_init(art_iterator *it, adaptive_radix_tree *art);
+/// @brief position the iterator before the first leaf not less than key
+void art_iterator_seek(art_iterator *it, const void *key, size_t len);
+/// @brief stop the iterator after the last leaf not greater than key, key must outlive the iterator
+void art_iterator_set_upper(art_iterator *it, const void *key, size_t len);
+/// @return the next leaf in key order, nullptr at the end
+/// @note the leaves stay valid until the end is reached or art_iterator_close is called
+leaf_node* art_iterator_next(art_iterator *it);
+/// @brief release an iterator that is not run to the end
+void art_iterator_close(art_iterator *it);
+/// @brief visit the leaves in [start, end] in key order until cb returns false
+/// @return the number of leaves visited
+size_t adaptive_radix_tree_range_scan(adaptive_radix_tree *art, const void *start, size_t start_len,
+                                      const void *end, size_t end_len, leaf_callback cb);
+/// @brief visit the leaves whose key starts with prefix in key order until cb returns false
+/// @return the number of leaves visited
+size_t adaptive_radix_tree_prefix_scan(adaptive_radix_tree *art, const void *prefix, size_t len,
+                                       leaf_callback cb);
+/// @brief read the counters of the operations that met a node replaced under them, over all trees
+void adaptive_radix_tree_get_retry_stats(art_retry_stats *stats);
 void adaptive_radix_tree_traverse(adaptive_radix_tree *art, art_callback cb); 
+/// @brief traverse on sidle::traverse_workers, cb is called concurrently by the workers
 void adaptive_radix_tree_traverse_mt(adaptive_radix_tree *art, art_callback cb);
-void init_thread_pool(int start_tid);
 /// @return migrate success or not
 art_node* leaf_migration(leaf_node* cur_node, art_node* parent, sidle::node_mem_type target_type);
 /// @return return parent node if migrate successfully, else return nullptr
+/// @param art is the tree of the node, its parent is looked up from the root without parent pointers
 art_node* internode_migration(art_node* original_node, sidle::node_mem_type target_type, 
-                        bool need_lock_first);
+                        bool need_lock_first, adaptive_radix_tree* art);
 void unlock_node(art_node* an);
 leaf_node* get_art_leaf(art_node* an);
+/// @return the parent of an inner node, nullptr for the root. Without parent pointers it is looked
+/// up from the root and may be stale by the time it is used
+art_node* get_art_parent(adaptive_radix_tree* art, art_node* an);
 bool is_art_leaf(art_node* an);
 } // namespace art
 
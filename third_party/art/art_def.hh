@@ -2,6 +2,7 @@
 #define _art_def_hh_
 
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <vector>
 
@@ -35,6 +36,9 @@
 #define get_count(version)           (int)(((version) >> 40) & 0xff)
 #define set_count(version, count)    (((version) & (~(((uint64_t)0xff) << 40))) | (((uint64_t)(count)) << 40))
 #define incr_count(version)          ((version) + ((uint64_t)1 << 40))
+#define decr_count(version)          ((version) - ((uint64_t)1 << 40))
+// node256 holds up to 256 children, its count overflows into the unused bit above
+#define get_count256(version)        (int)(((version) >> 40) & 0x1ff)
 #define get_node_type(version)            (int)((version) & node256)
 #define set_type(version, type)      ((version) | type)
 
@@ -59,6 +63,7 @@
 #define incr_vexpand(version) (((version) & ~((uint64_t)0xff)) | (((version) + 1) & 0xff)) // overflow is handled
 
 #define LEAF_DEPTH 8 // leaf node depth
+// for inner node pointers, leaf child pointers may carry a tag in the high bits
 #define IS_VALID_ADDR(addr) ((addr >> 48) == 0)
 
 namespace art {
@@ -134,20 +139,163 @@ struct leaf_node
 };
 #pragma pack(pop)
 
+/// @brief values up to this size are stored in the leaf by default, see SIDLE_ART_INLINE_VALUE_SIZE
+constexpr size_t art_default_inline_value_size = 64;
+constexpr size_t art_max_inline_value_size = 4096;
+/// @brief the capacity of a leaf_value whose data holds a pointer to an art_value_block
+constexpr uint16_t art_value_in_heap = 0xffff;
+#define LEAF_VALUE_LOCK  ((uint32_t)1)
+#define LEAF_VALUE_MOVED ((uint32_t)2)
+
+// the value of a leaf, right after its key at the next 8 byte boundary
+struct leaf_value
+{
+  // a seqlock for the value, LEAF_VALUE_MOVED is set once the leaf is replaced or removed
+  uint32_t version;
+  uint16_t length;   // length of an inline value
+  uint16_t capacity; // bytes reserved for an inline value, or art_value_in_heap
+  char data[];
+};
+
+// an out-of-line value, allocated in the tier of its leaf
+struct art_value_block
+{
+  sidle::node_metadata sidle_meta;
+  uint32_t capacity;
+  uint32_t length;
+  char data[];
+};
+
+inline size_t get_leaf_value_offset(size_t key_length)
+{
+  return (sizeof(leaf_node) + key_length + 7) & ~(size_t)7;
+}
+
+inline leaf_value* get_leaf_value(leaf_node *leaf)
+{
+  return (leaf_value *)((char *)leaf + get_leaf_value_offset(leaf->key_length));
+}
+
+inline size_t get_leaf_size(leaf_node *leaf)
+{
+  leaf_value *lv = get_leaf_value(leaf);
+  return get_leaf_value_offset(leaf->key_length) + sizeof(leaf_value) +
+         (lv->capacity == art_value_in_heap ? sizeof(art_value_block *) : lv->capacity);
+}
+
+/// @brief the lookups adaptive_radix_tree_multi_get keeps in flight
+constexpr size_t art_multi_get_group = 8;
+
+// see adaptive_radix_tree_get_retry_stats
+struct art_retry_stats
+{
+  uint64_t restarts; // operations that started over from the root
+  uint64_t forwards; // old nodes followed to the node that replaced them
+};
+
+// a key and its value for adaptive_radix_tree_bulk_load
+struct art_bulk_entry
+{
+  const void *key;
+  size_t len;
+  const void *value;
+  size_t value_len;
+};
+
 struct adaptive_radix_tree
 {
   art_node *root;
 };
 
+/**
+ *   leaf child pointer layout(64 bits), the tag is 0 unless art_leaf_tags is set
+ *     tagged  remote  fingerprint        address        leaf
+ *   |   1   |   1   |     14     |        47        |   1   |
+ *
+**/
+#define LEAF_TAG_BIT         ((uint64_t)1 << 63)
+#define LEAF_REMOTE_BIT      ((uint64_t)1 << 62)
+#define LEAF_FINGERPRINT_OFF 48
+#define LEAF_FINGERPRINT_MASK ((uint64_t)0x3fff << LEAF_FINGERPRINT_OFF)
+#define LEAF_ADDR_MASK       ((((uint64_t)1 << 48) - 1) & ~(uint64_t)1)
+
 #define is_leaf(ptr) ((uintptr_t)(ptr) & 1)
 #define make_leaf(ptr) ((uintptr_t)((const char *)(ptr) - 1) | 1)
-#define get_leaf_key(ptr) (((const char *)((uintptr_t)(ptr) & (~(uintptr_t)1))) + 4)
-#define get_leaf_len(ptr) ((size_t)*(char *)((uintptr_t)(ptr) & (~(uintptr_t)1)))
-#define get_leaf(ptr) ((leaf_node *)((uintptr_t)(ptr) & (~(uintptr_t)1)))
+#define get_leaf_key(ptr) (((const char *)((uintptr_t)(ptr) & LEAF_ADDR_MASK)) + 4)
+#define get_leaf_len(ptr) ((size_t)*(char *)((uintptr_t)(ptr) & LEAF_ADDR_MASK))
+#define get_leaf(ptr) ((leaf_node *)((uintptr_t)(ptr) & LEAF_ADDR_MASK))
+
+// tag the leaf child pointers with a fingerprint of the key and the tier of the leaf, see
+// SIDLE_ART_LEAF_TAGS
+extern bool art_leaf_tags;
+
+inline uint64_t art_key_fingerprint(const void *key, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t h = len, w;
+  for (; len >= 8; p += 8, len -= 8) {
+    memcpy(&w, p, 8);
+    h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+  }
+  for (; len; ++p, --len)
+    h = (h ^ *p) * 0x9e3779b97f4a7c15ULL;
+  return (h >> 50) << LEAF_FINGERPRINT_OFF;
+}
+
+// the child pointer of a leaf in type
+inline uintptr_t make_tagged_leaf(leaf_node *leaf, sidle::node_mem_type type)
+{
+  uintptr_t ptr = make_leaf((const char *)leaf + 1);
+  if (art_leaf_tags) {
+    ptr |= LEAF_TAG_BIT | art_key_fingerprint(leaf->key, leaf->key_length) |
+           (type == sidle::node_mem_type::remote ? LEAF_REMOTE_BIT : 0);
+  }
+  return ptr;
+}
+
+// return 1 if the tag of a leaf child pointer tells that it does not hold key
+inline int art_leaf_tag_mismatch(const void *ptr, const void *key, size_t len)
+{
+  uintptr_t p = (uintptr_t)ptr;
+  return (p & LEAF_TAG_BIT) && (p & LEAF_FINGERPRINT_MASK) != art_key_fingerprint(key, len);
+}
+
+// return 1 if the tier of a leaf can be read off its child pointer
+inline int art_leaf_tier_tagged(const void *ptr)
+{
+  return ((uintptr_t)ptr & LEAF_TAG_BIT) != 0;
+}
+
+inline sidle::node_mem_type art_leaf_tagged_tier(const void *ptr)
+{
+  return ((uintptr_t)ptr & LEAF_REMOTE_BIT) ? sidle::node_mem_type::remote : sidle::node_mem_type::local;
+}
 
 typedef std::function<void(art_node*, leaf_node*)> art_callback;
 /// @brief if the callback returns false, the traversal will be stopped
 typedef std::function<bool(art_node*)> node_callback;
+/// @brief if the callback returns false, the scan will be stopped
+typedef std::function<bool(leaf_node*)> leaf_callback;
+
+/// @brief the leaves an iterator collects per descent from the root
+constexpr int art_iterator_batch = 32;
+
+// an ordered cursor over the leaves of an art. it collects a batch of leaves per descent and
+// descends again from the last returned key, which is also how it restarts when a node
+// changes under it
+struct art_iterator
+{
+  adaptive_radix_tree *art;
+  leaf_node *batch[art_iterator_batch];
+  int pos, count;
+  int exclusive; // whether `key` itself has been returned
+  int end;       // no leaf is left after the batch
+  int held;      // the iterator holds an epoch critical section
+  const unsigned char *upper; // inclusive upper bound, 0 for none
+  size_t upper_len;
+  size_t len;
+  unsigned char key[256];
+};
 
 } // namespace art
 
@@ -20,6 +20,7 @@
 
 #include "art_node.hh"
 #include "sidle_meta.hh"
+#include "sidle_copy.hh"
 
 // #define CAL_TOTAL_MEM_USAGE
 
@@ -82,15 +83,20 @@ static inline art_node* art_node_get_parent(art_node *an)
 }
 
 
+static_assert(sizeof(art_node256) <= sidle::slab_max_object_size,
+              "every art node should be served by the node slab");
+
 /// @param old_size is used for node expansion 
+/// @param depth the depth of the node, 0 to derive it from parent
 art_node* _new_art_node(size_t size, art_node* parent, size_t old_size,
-                  sidle::node_mem_type target_type, bool is_migration)
+                  sidle::node_mem_type target_type, bool is_migration, uint8_t depth)
 {
   #ifdef Allocator
+  (void)depth;
   art_node *an = (art_node *)allocator_alloc(size);
   #else  
   art_node *an = sidle::sidle_alloc<art_node, art_node>(size, parent, target_type, 
-                                          is_migration, false, old_size);
+                                          is_migration, false, old_size, depth);
   #endif
 #ifdef RECORD_NODE_GEN
   // static uint64_t record_cnt = 0;
@@ -109,35 +115,35 @@ art_node* _new_art_node(size_t size, art_node* parent, size_t old_size,
   return an;
 }
 
-static inline art_node* new_art_node4(art_node* parent, size_t old_size = 0)
+static inline art_node* new_art_node4(art_node* parent, size_t old_size = 0, uint8_t depth = 0)
 {
   art_node *an = _new_art_node(sizeof(art_node4), parent, old_size,     
-                                sidle::node_mem_type::unknown, false);
+                                sidle::node_mem_type::unknown, false, depth);
   an->version = set_type(an->version, node4);
   return an;
 }
 
-static inline art_node* new_art_node16(art_node* parent, size_t old_size = 0)
+static inline art_node* new_art_node16(art_node* parent, size_t old_size = 0, uint8_t depth = 0)
 {
   art_node *an = _new_art_node(sizeof(art_node16), parent, old_size, 
-                                sidle::node_mem_type::unknown, false);           
+                                sidle::node_mem_type::unknown, false, depth);           
   an->version = set_type(an->version, node16);
   return an;
 }
 
-static inline art_node* new_art_node48(art_node* parent, size_t old_size = 0)
+static inline art_node* new_art_node48(art_node* parent, size_t old_size = 0, uint8_t depth = 0)
 {
   art_node *an = _new_art_node(sizeof(art_node48), parent, old_size, 
-                                sidle::node_mem_type::unknown, false);         
+                                sidle::node_mem_type::unknown, false, depth);         
   an->version = set_type(an->version, node48);
   memset(((art_node48 *)an)->index, 0, 256);
   return an;
 }
 
-static inline art_node* new_art_node256(art_node* parent, size_t old_size = 0)
+static inline art_node* new_art_node256(art_node* parent, size_t old_size = 0, uint8_t depth = 0)
 {
   art_node *an = _new_art_node(sizeof(art_node256), parent, old_size, 
-                                sidle::node_mem_type::unknown, false); 
+                                sidle::node_mem_type::unknown, false, depth); 
   memset(((art_node256 *)an)->child, 0, 256 * sizeof(art_node *));
   an->version = set_type(an->version, node256);
   return an;
@@ -148,43 +154,298 @@ art_node* new_art_node(art_node* parent)
   return new_art_node4(parent);
 }
 
+art_node* new_art_node_bulk(art_node* parent, int count, sidle::node_mem_type target_type,
+                            const void *key, size_t off, int prefix_len)
+{
+  uint64_t type;
+  size_t size;
+  if (count <= 4) {
+    type = node4;
+    size = sizeof(art_node4);
+  } else if (count <= 16) {
+    type = node16;
+    size = sizeof(art_node16);
+  } else if (count <= 48) {
+    type = node48;
+    size = sizeof(art_node48);
+  } else {
+    type = node256;
+    size = sizeof(art_node256);
+  }
+  #ifdef Allocator
+  (void)target_type;
+  art_node *an = (art_node *)allocator_alloc(size);
+  #else
+  art_node *an = sidle::sidle_place<art_node, art_node>(size, parent, target_type);
+  #endif
+  an->version = set_type((uint64_t)0, type);
+  an->new_ = 0;
+  an->parent = parent;
+  if (type == node48)
+    memset(((art_node48 *)an)->index, 0, 256);
+  else if (type == node256)
+    memset(((art_node256 *)an)->child, 0, 256 * sizeof(art_node *));
+  art_node_set_offset(an, off);
+  art_node_set_prefix(an, key, off, prefix_len);
+#ifdef CAL_TOTAL_MEM_USAGE
+  update_memory_usage(size);
+#endif
+  return an;
+}
+
+size_t art_inline_value_size = art_default_inline_value_size;
+bool art_leaf_tags = false;
+bool art_parent_ptrs = true;
+
+static art_value_block* alloc_value_block(sidle::node_mem_type type, size_t capacity, bool is_migration)
+{
+  art_value_block *blk = sidle::sidle_alloc<art_value_block, art_node>(
+      sizeof(art_value_block) + capacity, nullptr, type, is_migration, false);
+  blk->capacity = static_cast<uint32_t>(capacity);
+  blk->length = 0;
+  return blk;
+}
+
+static void retire_value_block(art_value_block *blk)
+{
+#if defined(CXL) && !defined(Allocator)
+  size_t size = sizeof(art_value_block) + blk->capacity;
+  sidle::node_allocator.account_retired(blk->sidle_meta.get_type(), size);
+  sidle::node_epoch.retire(blk->sidle_meta.get_type(), blk, size);
+#else
+  (void)blk;
+#endif
+}
+
+// an out-of-line value replaced or removed leaves the local budget at once, its memory is
+// retired since concurrent readers may still copy from it
+static void release_value_block(art_value_block *blk)
+{
+#if defined(CXL) && !defined(Allocator)
+  size_t size = sizeof(art_value_block) + blk->capacity;
+  sidle::strategy_manager.update_local_memory_usage(blk->sidle_meta.get_type(), blk->sidle_meta.depth,
+                                          -static_cast<int64_t>(size));
+#endif
+  retire_value_block(blk);
+}
+
+static inline art_value_block* get_value_block(leaf_value *lv)
+{
+  art_value_block *blk;
+  memcpy(&blk, lv->data, sizeof(blk));
+  return blk;
+}
+
+static inline void set_value_block(leaf_value *lv, art_value_block *blk)
+{
+  memcpy(lv->data, &blk, sizeof(blk));
+}
+
+// the data of a leaf_value is 8 byte aligned, the pointer to the block is read and written atomically
+// where a lock-free reader may race with the writer
+static inline art_value_block* load_value_block(leaf_value *lv)
+{
+  return __atomic_load_n(reinterpret_cast<art_value_block **>(lv->data), __ATOMIC_ACQUIRE);
+}
+
+static inline void publish_value_block(leaf_value *lv, art_value_block *blk)
+{
+  __atomic_store_n(reinterpret_cast<art_value_block **>(lv->data), blk, __ATOMIC_RELEASE);
+}
+
 uintptr_t alloc_leaf(art_node* parent, const void* key, size_t len,
-                    sidle::node_mem_type target_type, bool is_migration) 
+                    sidle::node_mem_type target_type, bool is_migration,
+                    const void* value, size_t value_len)
 {
-  size_t leaf_size = sizeof(leaf_node) + len;
+  // the inline space also holds the pointer of a value that outgrows it later
+  int in_heap = value_len > art_inline_value_size;
+  size_t capacity = in_heap ? sizeof(art_value_block *) : (value_len + 7) & ~(size_t)7;
+  if (capacity < sizeof(art_value_block *))
+    capacity = sizeof(art_value_block *);
+  size_t leaf_size = get_leaf_value_offset(len) + sizeof(leaf_value) + capacity;
   leaf_node* node = sidle::sidle_alloc<leaf_node, art_node>(leaf_size, parent, 
                                       target_type, is_migration, true);
   node->key_length = static_cast<uint8_t>(len);
   memcpy(node->key, key, len);
+  leaf_value *lv = get_leaf_value(node);
+  lv->version = 0;
+  if (in_heap) {
+    art_value_block *blk = alloc_value_block(node->sidle_meta.get_type(), value_len, is_migration);
+    memcpy(blk->data, value, value_len);
+    blk->length = static_cast<uint32_t>(value_len);
+    lv->length = 0;
+    lv->capacity = art_value_in_heap;
+    set_value_block(lv, blk);
+  } else {
+    if (value_len)
+      memcpy(lv->data, value, value_len);
+    lv->length = static_cast<uint16_t>(value_len);
+    lv->capacity = static_cast<uint16_t>(capacity);
+  }
 #ifdef CAL_TOTAL_MEM_USAGE
   update_memory_usage(leaf_size);
 #endif
-  return make_leaf(reinterpret_cast<char*>(node) + 1);
+  return make_tagged_leaf(node, node->sidle_meta.get_type());
 }
 
-void free_art_node(art_node *an)
+// require: the value of leaf is locked
+uintptr_t alloc_leaf_copy(art_node* parent, leaf_node* leaf, sidle::node_mem_type target_type)
 {
-  #ifdef Allocator
-  (void)an;
-  #else
-#ifdef CXL
-  int64_t memory_usage = 0;
-  switch (get_node_type(an->version)) {
+  size_t leaf_size = get_leaf_size(leaf);
+  leaf_node* node = sidle::sidle_alloc<leaf_node, art_node>(leaf_size, parent,
+                                      target_type, true, true);
+  sidle::copy_node(node, leaf, leaf_size, target_type);
+  leaf_value *lv = get_leaf_value(node);
+  lv->version = 0;
+  if (lv->capacity == art_value_in_heap) {
+    // an out-of-line value follows its leaf to the new tier
+    art_value_block *old = get_value_block(lv);
+    art_value_block *blk = alloc_value_block(target_type, old->capacity, true);
+    sidle::copy_node(blk->data, old->data, old->length, target_type);
+    blk->length = old->length;
+    set_value_block(lv, blk);
+    if (old->sidle_meta.get_type() == target_type) {
+      // relocated within its tier, the new copy was charged, the old one leaves
+      release_value_block(old);
+    } else {
+      retire_value_block(old);
+    }
+  }
+#ifdef CAL_TOTAL_MEM_USAGE
+  update_memory_usage(leaf_size);
+#endif
+  return make_tagged_leaf(node, target_type);
+}
+
+// return 0 on success, 1 if the leaf has been replaced or removed
+int art_leaf_value_lock(leaf_node *leaf)
+{
+  leaf_value *lv = get_leaf_value(leaf);
+  while (1) {
+    uint32_t version = __atomic_load_n(&lv->version, __ATOMIC_ACQUIRE);
+    if (unlikely(version & LEAF_VALUE_MOVED))
+      return 1;
+    if (version & LEAF_VALUE_LOCK) {
+      __asm__ volatile("pause" ::: "memory");
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&lv->version, &version, version | LEAF_VALUE_LOCK,
+      1 /* weak */, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return 0;
+  }
+}
+
+// require: the value of leaf is locked
+void art_leaf_value_unlock(leaf_node *leaf, int moved)
+{
+  leaf_value *lv = get_leaf_value(leaf);
+  uint32_t version = (lv->version + 4) & ~LEAF_VALUE_LOCK;
+  if (moved)
+    version |= LEAF_VALUE_MOVED;
+  __atomic_store_n(&lv->version, version, __ATOMIC_RELEASE);
+}
+
+int art_leaf_value_is_moved(leaf_node *leaf)
+{
+  return !!(__atomic_load_n(&get_leaf_value(leaf)->version, __ATOMIC_ACQUIRE) & LEAF_VALUE_MOVED);
+}
+
+int64_t art_leaf_read_value(leaf_node *leaf, void *buf, size_t cap)
+{
+  leaf_value *lv = get_leaf_value(leaf);
+  while (1) {
+    uint32_t version = __atomic_load_n(&lv->version, __ATOMIC_ACQUIRE);
+    if (version & LEAF_VALUE_LOCK) {
+      __asm__ volatile("pause" ::: "memory");
+      continue;
+    }
+    size_t len;
+    // the capacity is published after the block pointer, and the pointer is only followed once the
+    // version shows the inline bytes were not being rewritten into it
+    if (__atomic_load_n(&lv->capacity, __ATOMIC_ACQUIRE) == art_value_in_heap) {
+      art_value_block *blk = load_value_block(lv);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&lv->version, __ATOMIC_RELAXED) != version)
+        continue;
+      len = blk->length;
+      cxl_emulate_access(blk, sizeof(art_value_block) + len);
+      memcpy(buf, blk->data, len < cap ? len : cap);
+    } else {
+      len = lv->length;
+      memcpy(buf, lv->data, len < cap ? len : cap);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&lv->version, __ATOMIC_RELAXED) == version)
+      return static_cast<int64_t>(len);
+  }
+}
+
+// require: the value of leaf is locked
+int art_leaf_value_equal(leaf_node *leaf, const void *value, size_t len)
+{
+  leaf_value *lv = get_leaf_value(leaf);
+  if (lv->capacity == art_value_in_heap) {
+    art_value_block *blk = get_value_block(lv);
+    return blk->length == len && memcmp(blk->data, value, len) == 0;
+  }
+  return lv->length == len && memcmp(lv->data, value, len) == 0;
+}
+
+// require: the value of leaf is locked
+void art_leaf_write_value(leaf_node *leaf, const void *value, size_t len)
+{
+  leaf_value *lv = get_leaf_value(leaf);
+  if (lv->capacity != art_value_in_heap) {
+    if (len <= lv->capacity) {
+      memcpy(lv->data, value, len);
+      lv->length = static_cast<uint16_t>(len);
+      return;
+    }
+    // the value outgrows the leaf, the inline space holds the pointer from now on
+    art_value_block *blk = alloc_value_block(leaf->sidle_meta.get_type(), len, false);
+    memcpy(blk->data, value, len);
+    blk->length = static_cast<uint32_t>(len);
+    publish_value_block(lv, blk);
+    lv->length = 0;
+    __atomic_store_n(&lv->capacity, art_value_in_heap, __ATOMIC_RELEASE);
+    return;
+  }
+  art_value_block *blk = get_value_block(lv);
+  if (len <= blk->capacity) {
+    memcpy(blk->data, value, len);
+    blk->length = static_cast<uint32_t>(len);
+    return;
+  }
+  art_value_block *new_ = alloc_value_block(leaf->sidle_meta.get_type(), len, false);
+  memcpy(new_->data, value, len);
+  new_->length = static_cast<uint32_t>(len);
+  publish_value_block(lv, new_);
+  release_value_block(blk);
+}
+
+size_t art_node_size(uint64_t version)
+{
+  switch (get_node_type(version)) {
   case node4:
-    memory_usage = sizeof(art_node4);
-    break;
+    return sizeof(art_node4);
   case node16:
-    memory_usage = sizeof(art_node16);
-    break;
+    return sizeof(art_node16);
   case node48:
-    memory_usage = sizeof(art_node48);
-    break;
+    return sizeof(art_node48);
   case node256:
-    memory_usage = sizeof(art_node256);
-    break;
+    return sizeof(art_node256);
   default:
-    break;
+    return 0;
   }
+}
+
+void free_art_node(art_node *an)
+{
+  #ifdef Allocator
+  (void)an;
+  #else
+#ifdef CXL
+  int64_t memory_usage = art_node_size(an->version);
 #ifdef CAL_TOTAL_MEM_USAGE
   update_memory_usage(-memory_usage);
 #endif
@@ -195,6 +456,80 @@ void free_art_node(art_node *an)
   #endif
 }
 
+void retire_art_node(art_node *an)
+{
+#if defined(CXL) && !defined(Allocator)
+  size_t size = art_node_size(an->version);
+  sidle::node_allocator.account_retired(an->sidle_meta.get_type(), size);
+  sidle::node_epoch.retire(an->sidle_meta.get_type(), an, size);
+#else
+  (void)an;
+#endif
+}
+
+void retire_art_leaf(leaf_node *leaf)
+{
+#if defined(CXL) && !defined(Allocator)
+  size_t size = get_leaf_size(leaf);
+  sidle::node_allocator.account_retired(leaf->sidle_meta.get_type(), size);
+  sidle::node_epoch.retire(leaf->sidle_meta.get_type(), leaf, size);
+#else
+  (void)leaf;
+#endif
+}
+
+void free_art_leaf(leaf_node *leaf)
+{
+#if defined(CXL) && !defined(Allocator)
+  leaf_value *lv = get_leaf_value(leaf);
+  if (lv->capacity == art_value_in_heap) {
+    art_value_block *blk = get_value_block(lv);
+    sidle::sidle_free<art_value_block>(blk, sizeof(art_value_block) + blk->capacity);
+  }
+  size_t size = get_leaf_size(leaf);
+  sidle::node_mem_type type = leaf->sidle_meta.get_type();
+  sidle::strategy_manager.update_local_memory_usage(type, leaf->sidle_meta.metadata.depth,
+                                                    -static_cast<int64_t>(size));
+  if (!sidle::node_allocator.deallocate(type, leaf, size))
+    free_with_cxl(leaf);
+#else
+  (void)leaf;
+#endif
+}
+
+void free_unpublished_art_node(art_node *an, art_node *shared)
+{
+  art_node_traverse(an, [shared](art_node *child) {
+    if (child != shared && is_leaf(child))
+      free_art_leaf(get_leaf(reinterpret_cast<char*>(child)));
+    return true;
+  });
+  free_art_node(an);
+}
+
+// a node removed by a delete leaves the local budget at once, its memory is retired like a
+// replaced node since concurrent readers may still hold it
+static void release_art_node(art_node *an)
+{
+#if defined(CXL) && !defined(Allocator)
+  sidle::strategy_manager.update_local_memory_usage(an->sidle_meta.get_type(), an->sidle_meta.depth,
+                                          -static_cast<int64_t>(art_node_size(an->version)));
+#endif
+  retire_art_node(an);
+}
+
+void release_art_leaf(leaf_node *leaf)
+{
+#if defined(CXL) && !defined(Allocator)
+  sidle::strategy_manager.update_local_memory_usage(leaf->sidle_meta.get_type(), leaf->sidle_meta.metadata.depth,
+                                          -static_cast<int64_t>(get_leaf_size(leaf)));
+#endif
+  leaf_value *lv = get_leaf_value(leaf);
+  if (lv->capacity == art_value_in_heap)
+    release_value_block(get_value_block(lv));
+  retire_art_leaf(leaf);
+}
+
 art_node** art_node_find_child(art_node *an, uint64_t version, unsigned char byte)
 {
   debug_assert_art(is_leaf(an) == 0);
@@ -246,18 +581,84 @@ art_node** art_node_find_child(art_node *an, uint64_t version, unsigned char byt
   return 0;
 }
 
+// return the child with the smallest byte not less than `byte` and store that byte in `found`,
+// return 0 if there is none
+art_node** art_node_next_child(art_node *an, uint64_t version, int byte, unsigned char *found)
+{
+  debug_assert_art(is_leaf(an) == 0);
+
+  switch (get_node_type(version)) {
+  case node4: {
+    // children of node4 and node16 are not ordered
+    art_node4 *an4 = (art_node4 *)an;
+    int best = -1;
+    for (int i = 0, count = get_count(version); i < count && i < 4; ++i)
+      if (an4->key[i] >= byte && (best < 0 || an4->key[i] < an4->key[best]))
+        best = i;
+    if (best >= 0) {
+      *found = an4->key[best];
+      return &(an4->child[best]);
+    }
+  }
+  break;
+  case node16: {
+    art_node16 *an16 = (art_node16 *)an;
+    int best = -1;
+    for (int i = 0, count = get_count(version); i < count && i < 16; ++i)
+      if (an16->key[i] >= byte && (best < 0 || an16->key[i] < an16->key[best]))
+        best = i;
+    if (best >= 0) {
+      *found = an16->key[best];
+      return &(an16->child[best]);
+    }
+  }
+  break;
+  case node48: {
+    art_node48 *an48 = (art_node48 *)an;
+    for (int i = byte; i < 256; ++i) {
+      int index = an48->index[i];
+      if (index) {
+        *found = i;
+        return &(an48->child[index - 1]);
+      }
+    }
+  }
+  break;
+  case node256: {
+    art_node256 *an256 = (art_node256 *)an;
+    for (int i = byte; i < 256; ++i)
+      if (an256->child[i]) {
+        *found = i;
+        return &(an256->child[i]);
+      }
+  }
+  break;
+  default:
+    assert(0);
+  }
+  return 0;
+}
+
 void art_node_set_new_node(art_node *old, art_node *new_)
 {
   __atomic_store(&old->new_, &new_, __ATOMIC_RELAXED);
 }
 
-static inline art_node* art_node_get_new_node(art_node *old)
+art_node* art_node_get_new_node(art_node *old)
 {
   art_node *new_;
   __atomic_load(&old->new_, &new_, __ATOMIC_RELAXED);
   return new_;
 }
 
+// a grow or a shrink allocates the node replacing `an` after the parent of `an`. Without parent
+// pointers the parent may already be reclaimed, the replacement then follows `an` itself. The
+// replacement is placed at the depth of `an`, passed explicitly since the hint may be `an`
+static inline art_node* art_node_replacement_hint(art_node *an)
+{
+  return art_parent_ptrs ? an->parent : an;
+}
+
 // require: node is locked
 static art_node* art_node_grow(art_node *an)
 {
@@ -268,8 +669,8 @@ static art_node* art_node_grow(art_node *an)
 
   switch (get_node_type(version)) {
   case node4: {
-    art_node16 *an16 = (art_node16 *)(new_ = new_art_node16(an->parent, 
-                                      sizeof(art_node16) - sizeof(art_node4)));
+    art_node16 *an16 = (art_node16 *)(new_ = new_art_node16(art_node_replacement_hint(an), 
+                                      sizeof(art_node16) - sizeof(art_node4), an->sidle_meta.depth));
     art_node4 *an4 = (art_node4 *)an;
     debug_assert_art(get_count(version) == 4);
     memcpy(an16->prefix, an4->prefix, 8);
@@ -278,15 +679,15 @@ static art_node* art_node_grow(art_node *an)
     for (int i = 0; i < 4; ++i) {
       an16->key[i] = an4->key[i];
       an16->child[i] = an4->child[i];
-      if (!is_leaf(an4->child[i]))
+      if (art_parent_ptrs && !is_leaf(an4->child[i]))
         an4->child[i]->parent = new_;
     }
     an16->version = set_count(an16->version, 4);
   }
   break;
   case node16: {
-    art_node48 *an48 = (art_node48 *)(new_ = new_art_node48(an->parent, 
-                                      sizeof(art_node48) - sizeof(art_node16)));
+    art_node48 *an48 = (art_node48 *)(new_ = new_art_node48(art_node_replacement_hint(an), 
+                                      sizeof(art_node48) - sizeof(art_node16), an->sidle_meta.depth));
     art_node16 *an16 = (art_node16 *)an;
     debug_assert_art(get_count(version) == 16);
     memcpy(an48->prefix, an16->prefix, 8);
@@ -294,7 +695,7 @@ static art_node* art_node_grow(art_node *an)
     an48->parent = an16->parent;
     for (int i = 0; i < 16; ++i) {
       an48->child[i] = an16->child[i];
-      if (!is_leaf(an16->child[i]))
+      if (art_parent_ptrs && !is_leaf(an16->child[i]))
         an16->child[i]->parent = new_;
       an48->index[an16->key[i]] = i + 1;
     }
@@ -302,8 +703,8 @@ static art_node* art_node_grow(art_node *an)
   }
   break;
   case node48: {
-    art_node256 *an256 = (art_node256 *)(new_ = new_art_node256(an->parent,
-                                    sizeof(art_node256) - sizeof(art_node48)));
+    art_node256 *an256 = (art_node256 *)(new_ = new_art_node256(art_node_replacement_hint(an),
+                                    sizeof(art_node256) - sizeof(art_node48), an->sidle_meta.depth));
     art_node48 *an48 = (art_node48 *)an;
     debug_assert_art(get_count(version) == 48);
     memcpy(an256->prefix, an48->prefix, 8);
@@ -313,10 +714,11 @@ static art_node* art_node_grow(art_node *an)
       int index = an48->index[i];
       if (index) {
         an256->child[i] = an48->child[index - 1];
-        if (!is_leaf(an48->child[index - 1]))
+        if (art_parent_ptrs && !is_leaf(an48->child[index - 1]))
           an48->child[index - 1]->parent = new_;
       }
     }
+    an256->version = set_count(an256->version, 48);
   }
   break;
   default:
@@ -324,10 +726,13 @@ static art_node* art_node_grow(art_node *an)
     assert(0);
   }
 
-  assert(art_node_lock(new_) == 0);
+  // a fresh node is never old, keep the call out of assert so NDEBUG builds still lock it
+  if (art_node_lock(new_))
+    assert(0);
   art_node_set_offset(new_, get_offset(version));
   art_node_set_new_node(an, new_);
   art_node_set_version(an, set_old(version));
+  retire_art_node(an);
   return new_;
 }
 
@@ -398,6 +803,7 @@ art_node** art_node_add_child(art_node *an, unsigned char byte, art_node *child,
     art_node256 *an256 = (art_node256 *)an;
     debug_assert_art(an256->child[byte] == 0);
     an256->child[byte] = child;
+    an256->version = incr_count(version);
   }
   break;
   default:
@@ -412,8 +818,223 @@ art_node** art_node_add_child(art_node *an, unsigned char byte, art_node *child,
   return 0;
 }
 
+// remove the child at byte from art_node, return the removed child or 0 if there is none
 // require: node is locked
-inline int art_node_is_full(art_node *an)
+art_node* art_node_remove_child(art_node *an, unsigned char byte)
+{
+  debug_assert_art(is_leaf(an) == 0);
+
+  uint64_t version = an->version;
+  debug_assert_art(is_locked(version));
+
+  art_node **slot = art_node_find_child(an, version, byte);
+  if (slot == 0)
+    return 0;
+  art_node *child = *slot;
+
+  // mark expand bit before moving children, readers validate it after they pick a child
+  version = set_expand(version);
+  art_node_set_version(an, version);
+
+  switch (get_node_type(version)) {
+  case node4: {
+    art_node4 *an4 = (art_node4 *)an;
+    // keep children packed, the last one fills the hole
+    int i = slot - an4->child, last = get_count(version) - 1;
+    an4->key[i] = an4->key[last];
+    an4->child[i] = an4->child[last];
+    an4->child[last] = 0;
+  }
+  break;
+  case node16: {
+    art_node16 *an16 = (art_node16 *)an;
+    int i = slot - an16->child, last = get_count(version) - 1;
+    an16->key[i] = an16->key[last];
+    an16->child[i] = an16->child[last];
+    an16->child[last] = 0;
+  }
+  break;
+  case node48: {
+    art_node48 *an48 = (art_node48 *)an;
+    int index = an48->index[byte], count = get_count(version);
+    if (index != count) {
+      for (int i = 0; i < 256; ++i)
+        if (an48->index[i] == count) {
+          an48->child[index - 1] = an48->child[count - 1];
+          an48->index[i] = index;
+          break;
+        }
+    }
+    an48->child[count - 1] = 0;
+    an48->index[byte] = 0;
+  }
+  break;
+  case node256: {
+    art_node256 *an256 = (art_node256 *)an;
+    an256->child[byte] = 0;
+  }
+  break;
+  default:
+    assert(0);
+  }
+
+  art_node_set_version_unsafe(an, decr_count(version));
+  return child;
+}
+
+// return 0 on success, 1 if the node is locked or old
+static int art_node_try_lock(art_node *an)
+{
+  uint64_t version = art_node_get_version(an);
+  if (is_locked(version) || is_old(version))
+    return 1;
+  return !__atomic_compare_exchange_n(&an->version, &version, set_lock(version),
+    0 /* weak */, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+// return the only child of a node4 with the node4's prefix and byte merged into its prefix,
+// or 0 if the merged prefix does not fit
+// require: node is locked, an inner child is returned locked
+static art_node* art_node_collapse(art_node *an)
+{
+  uint64_t version = an->version;
+  art_node4 *an4 = (art_node4 *)an;
+  art_node *child = an4->child[0];
+
+  debug_assert_art(get_count(version) == 1);
+
+  if (!is_leaf(child)) {
+    // a child is locked before its parent everywhere else, so we can only try here
+    if (art_node_try_lock(child))
+      return 0;
+    uint64_t cv = child->version;
+    int prefix_len = get_prefix_len(version), child_prefix_len = get_prefix_len(cv);
+    if (prefix_len + 1 + child_prefix_len > 8) {
+      art_node_unlock(child);
+      return 0;
+    }
+    // mark expand bit before moving the prefix, like art_node_truncate_prefix
+    cv = set_expand(cv);
+    art_node_set_version(child, cv);
+    memmove(child->prefix + prefix_len + 1, child->prefix, child_prefix_len);
+    child->prefix[prefix_len] = an4->key[0];
+    memcpy(child->prefix, an->prefix, prefix_len);
+    cv = set_prefix_len(cv, prefix_len + 1 + child_prefix_len);
+    cv = set_offset(cv, get_offset(version));
+    art_node_set_version_unsafe(child, cv);
+    art_node_set_new_node(an, child);
+  }
+
+  art_node_set_version(an, set_old(version));
+  release_art_node(an);
+  return child;
+}
+
+// return the node taking the place of a sparse node, which is a smaller node holding its
+// children or, for a node4 left with one child, that child; return 0 if the node stays
+// require: node is locked, a returned inner node is locked as well
+art_node* art_node_shrink(art_node *an)
+{
+  art_node *new_;
+  uint64_t version = an->version;
+  int count;
+
+  debug_assert_art(is_locked(version));
+
+  // shrink well below the capacity of the smaller type, so that a node does not bounce
+  // between two types on alternating inserts and deletes.
+  // a grow charges the local budget with the size of the smaller type, passing twice that
+  // size as `old_size` gives it back
+  switch (get_node_type(version)) {
+  case node4:
+    if (get_count(version) != 1)
+      return 0;
+    return art_node_collapse(an);
+  case node16: {
+    if ((count = get_count(version)) > 3)
+      return 0;
+    art_node4 *an4 = (art_node4 *)(new_ = new_art_node4(art_node_replacement_hint(an), 2 * sizeof(art_node4),
+                                                          an->sidle_meta.depth));
+    art_node16 *an16 = (art_node16 *)an;
+    for (int i = 0; i < count; ++i) {
+      an4->key[i] = an16->key[i];
+      an4->child[i] = an16->child[i];
+      if (art_parent_ptrs && !is_leaf(an16->child[i]))
+        an16->child[i]->parent = new_;
+    }
+  }
+  break;
+  case node48: {
+    if ((count = get_count(version)) > 12)
+      return 0;
+    art_node16 *an16 = (art_node16 *)(new_ = new_art_node16(art_node_replacement_hint(an), 2 * sizeof(art_node16),
+                                                             an->sidle_meta.depth));
+    art_node48 *an48 = (art_node48 *)an;
+    for (int i = 0, j = 0; i < 256; ++i) {
+      int index = an48->index[i];
+      if (index) {
+        an16->key[j] = i;
+        an16->child[j] = an48->child[index - 1];
+        if (art_parent_ptrs && !is_leaf(an48->child[index - 1]))
+          an48->child[index - 1]->parent = new_;
+        ++j;
+      }
+    }
+  }
+  break;
+  case node256: {
+    if ((count = get_count256(version)) > 37)
+      return 0;
+    art_node48 *an48 = (art_node48 *)(new_ = new_art_node48(art_node_replacement_hint(an), 2 * sizeof(art_node48),
+                                                             an->sidle_meta.depth));
+    art_node256 *an256 = (art_node256 *)an;
+    for (int i = 0, j = 0; i < 256; ++i) {
+      if (an256->child[i]) {
+        an48->child[j] = an256->child[i];
+        if (art_parent_ptrs && !is_leaf(an256->child[i]))
+          an256->child[i]->parent = new_;
+        an48->index[i] = ++j;
+      }
+    }
+  }
+  break;
+  default:
+    assert(0);
+    return 0;
+  }
+
+  memcpy(new_->prefix, an->prefix, 8);
+  new_->version = set_prefix_len(new_->version, get_prefix_len(version));
+  new_->version = set_count(new_->version, count);
+  new_->parent = an->parent;
+  if (art_node_lock(new_))
+    assert(0);
+  art_node_set_offset(new_, get_offset(version));
+  art_node_set_new_node(an, new_);
+  art_node_set_version(an, set_old(version));
+  retire_art_node(an);
+  return new_;
+}
+
+// whether art_node_shrink may replace the node, so that the caller locks the parent first
+// require: node is locked
+int art_node_may_shrink(art_node *an)
+{
+  uint64_t version = an->version;
+
+  debug_assert_art(is_locked(version));
+
+  switch (get_node_type(version)) {
+  case node4  : return get_count(version) == 1;
+  case node16 : return get_count(version) <= 3;
+  case node48 : return get_count(version) <= 12;
+  case node256: return get_count256(version) <= 37;
+  default: return 0;
+  }
+}
+
+// require: node is locked
+int art_node_is_full(art_node *an)
 {
   uint64_t version = an->version;
 
@@ -552,7 +1173,8 @@ int art_node_version_is_old(uint64_t version)
 }
 
 art_node* art_node_replace_leaf_child(art_node *parent, art_node *an, 
-                                      const void *key, size_t len, size_t off)
+                                      const void *key, size_t len, size_t off,
+                                      const void *value, size_t value_len)
 {
   debug_assert_art(is_leaf(an));
 
@@ -577,17 +1199,20 @@ art_node* art_node_replace_leaf_child(art_node *parent, art_node *an,
   art_node *new_ = new_art_node(parent);
   new_->parent = parent;
   art_node_set_offset(new_, off);
-  assert(art_node_lock(new_) == 0);
+  if (art_node_lock(new_))
+    assert(0);
   // TODO: i - off might be bigger than 8
   assert(i - off <= 8);
   art_node_set_prefix(new_, k1, off, i - off);
   off = i;
   unsigned char byte;
   byte = off == l1 ? 0 : k1[off];
-  assert(art_node_add_child(new_, byte, an, 0) == 0);
+  if (art_node_add_child(new_, byte, an, 0))
+    assert(0);
   byte = off == l2 ? 0 : k2[off];
-  assert(art_node_add_child(new_, byte, 
-        (art_node *)alloc_leaf(new_, k2, len), 0) == 0);
+  if (art_node_add_child(new_, byte, (art_node *)alloc_leaf(new_, k2, len,
+        sidle::node_mem_type::remote, false, value, value_len), 0))
+    assert(0);
   // update the leaf node's depth
   get_leaf(reinterpret_cast<char*>(an))->sidle_meta.metadata.depth = 
         std::max(get_leaf(reinterpret_cast<char*>(an))->sidle_meta.metadata.depth,
@@ -604,29 +1229,33 @@ art_node* art_node_replace_leaf_child(art_node *parent, art_node *an,
 
 // require: node is locked
 art_node* art_node_expand_and_insert(art_node *parent, art_node *an, 
-                            const void *key, size_t len, size_t off, int common)
+                            const void *key, size_t len, size_t off, int common,
+                            const void *value, size_t value_len)
 {
   debug_assert_art(is_locked(an->version));
   
   art_node* new_ = new_art_node(parent);
   new_->parent = parent;
   art_node_set_offset(new_, off);
-  assert(art_node_lock(new_) == 0);
+  if (art_node_lock(new_))
+    assert(0);
   art_node_set_prefix(new_, key, off, common);
   unsigned char byte;
   byte = (off + common < len) ? ((unsigned char *)key)[off + common] : 0;
-  assert(art_node_add_child(new_, byte, 
-        (art_node *)alloc_leaf(new_, key, len), 0) == 0);
+  if (art_node_add_child(new_, byte, (art_node *)alloc_leaf(new_, key, len,
+        sidle::node_mem_type::remote, false, value, value_len), 0))
+    assert(0);
   // assert(art_node_add_child(new_, byte, (art_node *)make_leaf(key), 0) == 0);
   byte = art_node_truncate_prefix(an, common);
-  assert(art_node_add_child(new_, byte, an, 0) == 0);
+  if (art_node_add_child(new_, byte, an, 0))
+    assert(0);
   // update old node's depth
   an->sidle_meta.depth = std::max(an->sidle_meta.depth, 
                               static_cast<uint8_t>(new_->sidle_meta.depth + 1));
 #ifdef RECORD_NODE_GEN
   printf("[DEBUG] update new node %p depth: %dm\n", an, an->sidle_meta.depth);
-  art_node_unlock(new_);
 #endif
+  art_node_unlock(new_);
 
   return new_;
 }
@@ -652,6 +1281,10 @@ void art_node_traverse(art_node *cur_node, node_callback cb) {
       int child_count = get_count(cur_node->version);
       art_node** child = reinterpret_cast<art_node4*>(cur_node)->child;
       for (int i = 0; i < child_count; ++i) {
+        // a slot emptied by a concurrent delete
+        if (child[i] == 0) {
+          continue;
+        }
         if (!cb(child[i])) {  // early stop
           break;
         }
@@ -662,6 +1295,9 @@ void art_node_traverse(art_node *cur_node, node_callback cb) {
       int child_count = get_count(cur_node->version);
       art_node** child = reinterpret_cast<art_node16*>(cur_node)->child;
       for (int i = 0; i < child_count; ++i) {
+        if (child[i] == 0) {
+          continue;
+        }
         if (!cb(child[i])) {  // early stop
           break;
         }
@@ -672,7 +1308,7 @@ void art_node_traverse(art_node *cur_node, node_callback cb) {
       art_node48* n48 = reinterpret_cast<art_node48*>(cur_node);
       for (int i = 0; i < 256; ++i) {
         char index = n48->index[i];
-        if (index) {
+        if (index && n48->child[index - 1]) {
           if (!cb(n48->child[index - 1])) { // early stop
             break;
           }
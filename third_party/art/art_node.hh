@@ -39,13 +39,52 @@ extern "C" {
 namespace art {
 
 art_node* new_art_node(art_node* parent);
+// a node of a bulk load with room for count children, placed in target_type without charging
+// the local budget, see sidle::sidle_place
+art_node* new_art_node_bulk(art_node* parent, int count, sidle::node_mem_type target_type,
+                            const void *key, size_t off, int prefix_len);
+// values longer than this are kept out of line, in a value block of the leaf's tier
+extern size_t art_inline_value_size;
+// keep the parent pointers of the inner nodes up to date, see SIDLE_ART_NO_PARENT_PTRS. Without
+// them a grow, a shrink or a migration does not rewrite the parent pointers of the children, the
+// parent of a node is found from the root instead and `parent` must not be followed
+extern bool art_parent_ptrs;
+
 uintptr_t alloc_leaf(art_node* parent, const void* key, size_t len, 
                     sidle::node_mem_type target_type = 
                       sidle::node_mem_type::remote, 
-                      bool is_migration = false);
+                      bool is_migration = false,
+                      const void* value = nullptr, size_t value_len = 0);
+// copy a leaf and its value to target_type for a migration, require: the value of leaf is locked
+uintptr_t alloc_leaf_copy(art_node* parent, leaf_node* leaf, sidle::node_mem_type target_type);
+// the size of a node of the type in version
+size_t art_node_size(uint64_t version);
 void free_art_node(art_node *an);
+// free a leaf no other thread has seen, together with its value
+void free_art_leaf(leaf_node *leaf);
+// free a node that was never published and its leaves, except shared which is still in the tree
+void free_unpublished_art_node(art_node *an, art_node *shared);
+// account a node or leaf unlinked from the tree but left to concurrent readers, see node_slab::account_retired
+void retire_art_node(art_node *an);
+void retire_art_leaf(leaf_node *leaf);
+// retire a leaf removed by a delete and give its size back to the local budget
+void release_art_leaf(leaf_node *leaf);
+// the value lock serializes writers of a leaf's value with its removal and migration,
+// return 0 on success, 1 if the leaf has been replaced or removed
+int art_leaf_value_lock(leaf_node *leaf);
+void art_leaf_value_unlock(leaf_node *leaf, int moved);
+int art_leaf_value_is_moved(leaf_node *leaf);
+// copy at most cap bytes of the value to buf, return the length of the value
+int64_t art_leaf_read_value(leaf_node *leaf, void *buf, size_t cap);
+// require: the value of leaf is locked
+int art_leaf_value_equal(leaf_node *leaf, const void *value, size_t len);
+void art_leaf_write_value(leaf_node *leaf, const void *value, size_t len);
 art_node** art_node_add_child(art_node *an, unsigned char byte, art_node *child, art_node **new_);
 art_node** art_node_find_child(art_node *an, uint64_t version, unsigned char byte);
+art_node** art_node_next_child(art_node *an, uint64_t version, int byte, unsigned char *found);
+art_node* art_node_remove_child(art_node *an, unsigned char byte);
+art_node* art_node_shrink(art_node *an);
+int art_node_may_shrink(art_node *an);
 int art_node_is_full(art_node *an);
 void art_node_set_prefix(art_node *an, const void *key, size_t off, int prefix_len);
 const char* art_node_get_prefix(art_node *an);
@@ -62,11 +101,15 @@ art_node* art_node_get_locked_parent(art_node *an);
 void art_node_set_parent_unsafe(art_node *an, art_node *parent);
 void art_node_unlock(art_node *an);
 int art_node_version_is_old(uint64_t version);
-art_node* art_node_replace_leaf_child(art_node *parent, art_node *an, const void *key, size_t len, size_t off);
+art_node* art_node_replace_leaf_child(art_node *parent, art_node *an, const void *key, size_t len, size_t off,
+                                      const void *value, size_t value_len);
 void art_node_replace_child(art_node *parent, unsigned char byte, art_node *old, art_node *new_);
-art_node* art_node_expand_and_insert(art_node *parent, art_node *an, const void *key, size_t len, size_t off, int common);
+art_node* art_node_expand_and_insert(art_node *parent, art_node *an, const void *key, size_t len, size_t off, int common,
+                                     const void *value, size_t value_len);
 size_t art_node_version_get_offset(uint64_t version);
 void art_node_set_new_node(art_node *old, art_node *new_);
+// the node that took the place of an old node, 0 if it was removed
+art_node* art_node_get_new_node(art_node *old);
 void art_node_set_version(art_node *an, uint64_t version);
 void art_node_traverse(art_node *cur_node, node_callback cb);
 #ifdef Debug
@@ -1,32 +1,100 @@
+#include <errno.h>
 #include <fcntl.h>
+#include <malloc.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include <threads.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <memkind.h>
 
 #include "cxl_allocator.h"
 
+// the malloc of the process is jemalloc, linked by the build. Weak, so a binary without it reports no usage
+extern int mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen) __attribute__((weak));
+
 #define thread_local _Thread_local
 
-static struct memkind *cxl_kind = NULL;
-static size_t cxl_current_size;
-static const char *path = "/dev/dax0.0";
+#define MAX_NUMA_NODES 1024
+#define MPOL_BIND_MODE 2    // MPOL_BIND in numaif.h, spelled out to avoid linking libnuma
+
+#define TIER_GRANULE ((size_t)1 << CXL_TIER_GRANULE_SHIFT)
+
+// a mapping of mmap_with_cxl and mmap_on_cxl outside the region itself. An unmapped extent keeps its
+// address range and its range of the device, a later map of at most capacity bytes takes it over
+struct cxl_extent {
+    char *start;
+    size_t capacity;            // bytes of address space and, for the fd backends, of the device
+    off_t offset;               // device offset of the fd backends
+    int free;
+    struct cxl_extent *next;
+};
+
+struct cxl_region {
+    struct memkind *kind;
+    char *start;                // start of the mapped memory, aligned to TIER_GRANULE
+    size_t size;                // size of the mapped memory
+    size_t reserved_size;       // size padded to TIER_GRANULE, the padding stays PROT_NONE
+    int fd;                     // backing fd of the devdax and file backends, -1 otherwise
+    int numa_node;              // target node of the numa backend
+    size_t device_size;         // end of the device range the extents may use, fd backends only
+    mtx_t extent_mtx;           // guards the fields below
+    struct cxl_extent *extents; // every extent, mapped or free
+    size_t mmap_offset;         // next device offset of a new extent
+    char *extent_next;          // unused part of the granules reserved for the extents
+    size_t extent_room;
+};
+
+static struct cxl_region cxl_regions[CXL_MAX_REGIONS];
+static int cxl_region_count = 0;
+static int cxl_initialized = 0;
+static struct cxl_config cxl_cfg;
+static int cxl_cfg_ready = 0;
 static int percentage_on_cxl;
-static char *mmap_start_point = NULL;
-static char *mmap_end_point = NULL;
-static int cxl_fd = 0;
-static atomic_size_t cxl_offset = CXL_MAX_SIZE;
-static size_t CXL_MIN_SIZE = 2 * 1024 * 1024;
+static double tsc_per_ns = 0;
+unsigned char cxl_tier_map[CXL_TIER_MAP_SIZE];
+int cxl_access_emulation = 0;
 static int local_stride;
 static int cxl_stride;
 static thread_local size_t local_ticket;
 static thread_local size_t cxl_ticket;
+static thread_local unsigned int region_cursor;
+
+// the allocation counters of one thread, only written by the owner thread and summed by cxl_get_tier_stats
+struct tier_counters {
+    atomic_size_t alloc_count;
+    atomic_size_t free_count;
+    atomic_size_t alloc_bytes;
+    atomic_size_t free_bytes;
+    atomic_size_t class_alloc[CXL_STATS_SIZE_CLASSES];
+    atomic_size_t class_free[CXL_STATS_SIZE_CLASSES];
+};
+
+// the blocks outlive their threads, so the counts of exited threads are kept
+struct stats_block {
+    struct tier_counters tiers[CXL_MAX_REGIONS + 1];
+    struct stats_block *next;
+};
+
+#define PROBE_SIZE ((size_t)64 << 20)     // larger than the LLC, so the probes reach the memory
+#define PROBE_LINE 64
+
+static struct tier_profile tier_profiles[CXL_MAX_REGIONS + 1];
+
+static int stats_enabled = 0;
+static void (*local_stats_hook)(struct cxl_tier_stats *stats) = NULL;
+static _Atomic(struct stats_block *) stats_blocks = NULL;
+static thread_local struct stats_block *local_stats;
 
 enum DEVICE_TYPE {
     CXL_DEV, 
@@ -50,20 +118,736 @@ int gcd(int a, int b) {
     return a;
 }
 
-void exit_handler(int singal_num) {
-    if (cxl_kind != NULL) {
-        int err = memkind_destroy_kind(cxl_kind);
-        if (err) {
-            print_err_message(err);
-        }   
+static const char *backend_name(enum cxl_backend_type backend)
+{
+    switch (backend) {
+    case CXL_BACKEND_DEVDAX:
+        return "devdax";
+    case CXL_BACKEND_ANON:
+        return "anon";
+    case CXL_BACKEND_FILE:
+        return "file";
+    case CXL_BACKEND_NUMA:
+        return "numa";
+    default:
+        return "unknown";
+    }
+}
+
+// parse a size with an optional K/M/G suffix, return 0 if the string is malformed
+static size_t parse_size(const char *str)
+{
+    char *end = NULL;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str) {
+        return 0;
+    }
+    switch (*end) {
+    case 'g': case 'G':
+        value <<= 10;
+        // fall through
+    case 'm': case 'M':
+        value <<= 10;
+        // fall through
+    case 'k': case 'K':
+        value <<= 10;
+        break;
+    default:
+        break;
+    }
+    return (size_t)value;
+}
+
+static inline size_t round_up(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+static inline int is_emulated_backend()
+{
+    return cxl_cfg.backend == CXL_BACKEND_ANON || cxl_cfg.backend == CXL_BACKEND_NUMA;
+}
+
+// bind an anonymous range to a node, using the raw syscall to avoid linking libnuma
+static int bind_to_numa_node(void *addr, size_t length, int node)
+{
+    unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+    if (node < 0 || node >= MAX_NUMA_NODES) {
+        fprintf(stderr, "invalid numa node %d for the cxl tier\n", node);
+        return -1;
     }
+    nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, addr, length, MPOL_BIND_MODE, nodemask, MAX_NUMA_NODES + 1, 0) != 0) {
+        perror("bind cxl tier to numa node fail");
+        return -1;
+    }
+    return 0;
+}
+
+// replace the pages of a range by PROT_NONE address space, the range stays reserved
+static void reserve_range(void *addr, size_t length)
+{
+    mmap(addr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+// map emulated memory of a region, used by the anon and numa backends
+static void *map_emulated_memory(const struct cxl_region *region, void *addr, size_t length, int prot, int flags)
+{
+    flags &= ~MAP_SHARED;
+    void *result = mmap(addr, length, prot, flags | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (result == MAP_FAILED) {
+        return result;
+    }
+    if (cxl_cfg.align >= CXL_MIN_SIZE) {
+        madvise(result, length, MADV_HUGEPAGE);
+    }
+    if (cxl_cfg.backend == CXL_BACKEND_NUMA && bind_to_numa_node(result, length, region->numa_node) != 0) {
+        // a fixed range stays reserved, it might be reused by a later map
+        if (flags & MAP_FIXED) {
+            reserve_range(result, length);
+        } else {
+            munmap(result, length);
+        }
+        return MAP_FAILED;
+    }
+    return result;
+}
+
+// reserve size bytes of PROT_NONE address space at a TIER_GRANULE boundary, size must be a multiple of
+// TIER_GRANULE so the reservation owns every granule it touches
+static char *reserve_granules(size_t size)
+{
+    // reserve one more granule to find an aligned start, then trim the reservation around it
+    char *reserved = mmap(NULL, size + TIER_GRANULE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    char *start = (char *)round_up((size_t)reserved, TIER_GRANULE);
+    if (start != reserved) {
+        munmap(reserved, start - reserved);
+    }
+    munmap(start + size, TIER_GRANULE - (start - reserved));
+    return start;
+}
 
-    // tear down mmap
-    if (munmap(mmap_start_point, cxl_current_size) == -1) {
-        fprintf(stderr, "tear down mmap fail\n");
+static void set_tier_range(const char *start, size_t size, int tier)
+{
+    size_t first = (size_t)start >> CXL_TIER_GRANULE_SHIFT;
+    size_t last = ((size_t)start + size) >> CXL_TIER_GRANULE_SHIFT;
+    for (size_t granule = first; granule < last && granule < CXL_TIER_MAP_SIZE; ++granule) {
+        cxl_tier_map[granule] = (unsigned char)tier;
+    }
+}
+
+// map a region at a TIER_GRANULE boundary and record it in the tier map, return 0 on success
+static int map_region(struct cxl_region *region, int tier)
+{
+    region->reserved_size = round_up(region->size, TIER_GRANULE);
+    char *start = reserve_granules(region->reserved_size);
+    if (start == MAP_FAILED) {
+        return -1;
+    }
+
+    void *mapped = MAP_FAILED;
+    if (region->fd >= 0) {
+        mapped = mmap(start, region->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, region->fd, 0);
+    } else {
+        mapped = map_emulated_memory(region, start, region->size, PROT_READ | PROT_WRITE, MAP_FIXED);
+    }
+    if (mapped == MAP_FAILED) {
+        munmap(start, region->reserved_size);
+        return -1;
+    }
+    region->start = start;
+    set_tier_range(start, region->reserved_size, tier);
+
+    // the extents of mmap_on_cxl follow the region on the device
+    mtx_init(&region->extent_mtx, mtx_plain);
+    region->extents = NULL;
+    region->mmap_offset = region->size;
+    region->extent_next = NULL;
+    region->extent_room = 0;
+    return 0;
+}
+
+// the size of the device behind a devdax fd, fallback if it is unknown
+static size_t devdax_size(int fd, size_t fallback)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISCHR(st.st_mode)) {
+        return fallback;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/size", major(st.st_rdev), minor(st.st_rdev));
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return fallback;
+    }
+    unsigned long long size = 0;
+    if (fscanf(file, "%llu", &size) != 1 || size < fallback) {
+        size = fallback;
+    }
+    fclose(file);
+    return (size_t)size;
+}
+
+// carve a free extent of at least length bytes out of the granules reserved for the extents and, for
+// the fd backends, out of the device past the region, NULL with errno set if either is exhausted
+// require: extent_mtx is held
+static struct cxl_extent *new_region_extent(struct cxl_region *region, size_t length)
+{
+    size_t capacity = round_up(length, cxl_cfg.align);
+    if (!is_emulated_backend()) {
+        if (region->mmap_offset + capacity > region->device_size ||
+            (cxl_cfg.backend == CXL_BACKEND_FILE && ftruncate(region->fd, region->mmap_offset + capacity) != 0)) {
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    struct cxl_extent *extent = malloc(sizeof(struct cxl_extent));
+    if (extent == NULL) {
+        return NULL;
+    }
+    // the extents share granules, the rest of the last reservation is left behind when it is too small
+    if (capacity > region->extent_room) {
+        size_t reserved_size = round_up(capacity, TIER_GRANULE);
+        char *start = reserve_granules(reserved_size);
+        if (start == MAP_FAILED) {
+            free(extent);
+            return NULL;
+        }
+        set_tier_range(start, reserved_size, (int)(region - cxl_regions) + 1);
+        region->extent_next = start;
+        region->extent_room = reserved_size;
+    }
+    extent->start = region->extent_next;
+    extent->capacity = capacity;
+    extent->offset = is_emulated_backend() ? 0 : (off_t)region->mmap_offset;
+    extent->free = 1;
+    extent->next = region->extents;
+    region->extents = extent;
+    region->extent_next += capacity;
+    region->extent_room -= capacity;
+    if (!is_emulated_backend()) {
+        region->mmap_offset += capacity;
+    }
+    return extent;
+}
+
+// map length more bytes of a region for mmap_with_cxl and mmap_on_cxl, on the smallest free extent
+// that is large enough or on a new one. The address hint is ignored
+static void *map_region_extent(struct cxl_region *region, size_t length, int prot, int flags)
+{
+    flags = (flags & ~(MAP_FIXED | MAP_ANONYMOUS)) | MAP_FIXED;
+    void *result = MAP_FAILED;
+    mtx_lock(&region->extent_mtx);
+    struct cxl_extent *extent = NULL;
+    for (struct cxl_extent *e = region->extents; e != NULL; e = e->next) {
+        if (e->free && e->capacity >= length && (extent == NULL || e->capacity < extent->capacity)) {
+            extent = e;
+        }
+    }
+    if (extent == NULL) {
+        extent = new_region_extent(region, length);
+    }
+    if (extent != NULL) {
+        if (is_emulated_backend()) {
+            result = map_emulated_memory(region, extent->start, length, prot, flags);
+        } else {
+            result = mmap(extent->start, length, prot, (flags & ~MAP_PRIVATE) | MAP_SHARED, region->fd,
+                          extent->offset);
+        }
+        extent->free = result == MAP_FAILED;
+    }
+    mtx_unlock(&region->extent_mtx);
+    return result;
+}
+
+// open the backing file of a region for the devdax and file backends
+static int open_region_file(const char *path, size_t size)
+{
+    if (cxl_cfg.backend == CXL_BACKEND_DEVDAX) {
+        int fd = open(path, O_RDWR);
+        if (fd < 0) {
+            fprintf(stderr, "the path for cxl %s not exist\n", path);
+            exit(EXIT_FAILURE);
+        }
+        return fd;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        fprintf(stderr, "the backing file %s for cxl can not be prepared\n", path);
         exit(EXIT_FAILURE);
     }
-    close(cxl_fd);
+    return fd;
+}
+
+// split a comma-separated list in place, return the number of items
+static int split_list(char *list, char **items, int max_items)
+{
+    int count = 0;
+    char *saveptr = NULL;
+    for (char *item = strtok_r(list, ",", &saveptr); item != NULL && count < max_items;
+         item = strtok_r(NULL, ",", &saveptr)) {
+        items[count++] = item;
+    }
+    return count;
+}
+
+static inline struct cxl_region *region_of_tier(int tier)
+{
+    return tier > CXL_LOCAL_TIER && tier <= cxl_region_count ? &cxl_regions[tier - 1] : NULL;
+}
+
+static inline size_t usable_size(void *ptr, int tier)
+{
+    struct cxl_region *region = region_of_tier(tier);
+    return region != NULL ? memkind_malloc_usable_size(region->kind, ptr) : malloc_usable_size(ptr);
+}
+
+static inline int stats_size_class(size_t size)
+{
+    int cls = size <= 16 ? 0 : 64 - __builtin_clzl(size - 1) - 4;
+    return cls < CXL_STATS_SIZE_CLASSES ? cls : CXL_STATS_SIZE_CLASSES - 1;
+}
+
+static struct stats_block *register_stats_block()
+{
+    struct stats_block *block = calloc(1, sizeof(struct stats_block));
+    if (block == NULL) {
+        fprintf(stderr, "fail to allocate the cxl stats counters\n");
+        exit(EXIT_FAILURE);
+    }
+    block->next = atomic_load(&stats_blocks);
+    while (!atomic_compare_exchange_weak(&stats_blocks, &block->next, block)) {
+    }
+    return block;
+}
+
+// the owner is the only writer, so a relaxed load and store replaces the atomic add
+static inline void counter_add(atomic_size_t *counter, size_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+static void record_stats_slow(void *ptr, int is_free)
+{
+    if (local_stats == NULL) {
+        local_stats = register_stats_block();
+    }
+    int tier = cxl_tier_of(ptr);
+    size_t size = usable_size(ptr, tier);
+    struct tier_counters *counters = &local_stats->tiers[tier];
+    if (is_free) {
+        counter_add(&counters->free_count, 1);
+        counter_add(&counters->free_bytes, size);
+        counter_add(&counters->class_free[stats_size_class(size)], 1);
+    } else {
+        counter_add(&counters->alloc_count, 1);
+        counter_add(&counters->alloc_bytes, size);
+        counter_add(&counters->class_alloc[stats_size_class(size)], 1);
+    }
+}
+
+// count an allocation, must be called before a free releases ptr
+static inline void record_stats(void *ptr, int is_free)
+{
+    if (__builtin_expect(stats_enabled, 0) && ptr != NULL) {
+        record_stats_slow(ptr, is_free);
+    }
+}
+
+// the region probed first by this thread, advanced on every successful allocation to interleave the regions
+static inline struct cxl_region *region_at(unsigned int i)
+{
+    return &cxl_regions[(region_cursor + i) % cxl_region_count];
+}
+
+static void *region_malloc(size_t size)
+{
+    for (int i = 0; i < cxl_region_count; ++i) {
+        void *result = memkind_malloc(region_at(i)->kind, size);
+        if (result != NULL) {
+            region_cursor += i + 1;
+            record_stats(result, 0);
+            return result;
+        }
+    }
+    return NULL;
+}
+
+static void *region_calloc(size_t num, size_t size)
+{
+    for (int i = 0; i < cxl_region_count; ++i) {
+        void *result = memkind_calloc(region_at(i)->kind, num, size);
+        if (result != NULL) {
+            region_cursor += i + 1;
+            record_stats(result, 0);
+            return result;
+        }
+    }
+    return NULL;
+}
+
+static int region_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    int result = -1;
+    for (int i = 0; i < cxl_region_count; ++i) {
+        result = memkind_posix_memalign(region_at(i)->kind, memptr, alignment, size);
+        if (result == 0) {
+            region_cursor += i + 1;
+            record_stats(*memptr, 0);
+            return result;
+        }
+    }
+    return result;
+}
+
+static inline uint64_t read_ns_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t read_cycle()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return read_ns_clock();
+#endif
+}
+
+// measure the cycle counter against the monotonic clock for the busy-wait of the emulation
+static void calibrate_cycle_counter()
+{
+    uint64_t start_ns = read_ns_clock(), start_cycle = read_cycle();
+    uint64_t end_ns = start_ns;
+    while (end_ns - start_ns < 10000000ULL) {
+        end_ns = read_ns_clock();
+    }
+    uint64_t end_cycle = read_cycle();
+    tsc_per_ns = (double)(end_cycle - start_cycle) / (double)(end_ns - start_ns);
+    if (tsc_per_ns <= 0) {
+        tsc_per_ns = 1;
+    }
+}
+
+// link the lines of the buffer into one random cycle (Sattolo's algorithm), so every load of the
+// chase depends on the previous one and defeats the prefetchers
+static void *build_pointer_chase(char *buf, size_t lines)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < lines; ++i) {
+        *(size_t *)(buf + i * PROBE_LINE) = i;
+    }
+    for (size_t i = lines - 1; i > 0; --i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        size_t j = seed % i;
+        size_t *a = (size_t *)(buf + i * PROBE_LINE), *b = (size_t *)(buf + j * PROBE_LINE);
+        size_t t = *a;
+        *a = *b;
+        *b = t;
+    }
+    for (size_t i = 0; i < lines; ++i) {
+        void **slot = (void **)(buf + i * PROBE_LINE);
+        *slot = buf + *(size_t *)slot * PROBE_LINE;
+    }
+    return buf;
+}
+
+// run the probes on a buffer of PROBE_SIZE bytes
+static void probe_memory(char *buf, struct tier_profile *profile)
+{
+    size_t lines = PROBE_SIZE / PROBE_LINE;
+    void **p = build_pointer_chase(buf, lines);
+    uint64_t start = read_ns_clock();
+    for (size_t i = 0; i < lines; ++i) {
+        p = (void **)*p;
+    }
+    uint64_t end = read_ns_clock();
+    __asm__ __volatile__("" :: "r"(p));
+    profile->latency_ns = (double)(end - start) / (double)lines;
+
+    const uint64_t *words = (const uint64_t *)buf;
+    uint64_t sum = 0;
+    start = read_ns_clock();
+    for (size_t i = 0; i < PROBE_SIZE / sizeof(uint64_t); i += 4) {
+        sum += words[i] ^ words[i + 1] ^ words[i + 2] ^ words[i + 3];
+    }
+    end = read_ns_clock();
+    __asm__ __volatile__("" :: "r"(sum));
+    // bytes per ns is GB/s, 1000 times that is MB/s
+    profile->read_bandwidth_mbps = (double)PROBE_SIZE * 1000.0 / (double)(end - start);
+
+    start = read_ns_clock();
+    memset(buf, (int)sum, PROBE_SIZE);
+    __asm__ __volatile__("" ::: "memory");
+    end = read_ns_clock();
+    profile->write_bandwidth_mbps = (double)PROBE_SIZE * 1000.0 / (double)(end - start);
+    profile->valid = 1;
+}
+
+// probe local memory and every region, the regions must be mapped
+static void calibrate_tiers()
+{
+    char *buf = NULL;
+    if (posix_memalign((void **)&buf, CXL_MIN_SIZE, PROBE_SIZE) == 0) {
+        madvise(buf, PROBE_SIZE, MADV_HUGEPAGE);
+        probe_memory(buf, &tier_profiles[CXL_LOCAL_TIER]);
+        free(buf);
+    }
+    for (int i = 0; i < cxl_region_count; ++i) {
+        struct tier_profile *profile = &tier_profiles[i + 1];
+        if (memkind_posix_memalign(cxl_regions[i].kind, (void **)&buf, CXL_MIN_SIZE, PROBE_SIZE) != 0) {
+            fprintf(stderr, "fail to allocate the calibration buffer on cxl region %d\n", i);
+            continue;
+        }
+        probe_memory(buf, profile);
+        memkind_free(cxl_regions[i].kind, buf);
+        // the emulation is charged by the index, not by the raw loads of the probe
+        profile->latency_ns += cxl_cfg.latency_ns;
+        if (cxl_cfg.bandwidth_mbps != 0) {
+            if (profile->read_bandwidth_mbps > cxl_cfg.bandwidth_mbps) {
+                profile->read_bandwidth_mbps = cxl_cfg.bandwidth_mbps;
+            }
+            if (profile->write_bandwidth_mbps > cxl_cfg.bandwidth_mbps) {
+                profile->write_bandwidth_mbps = cxl_cfg.bandwidth_mbps;
+            }
+        }
+    }
+    for (int tier = CXL_LOCAL_TIER; tier <= cxl_region_count; ++tier) {
+        if (tier_profiles[tier].valid) {
+            printf("[DEBUG] tier %d profile: latency %.1f ns, read %.0f MB/s, write %.0f MB/s\n", tier,
+                   tier_profiles[tier].latency_ns, tier_profiles[tier].read_bandwidth_mbps,
+                   tier_profiles[tier].write_bandwidth_mbps);
+        }
+    }
+}
+
+int cxl_get_tier_profile(int tier, struct tier_profile *profile)
+{
+    if (tier < CXL_LOCAL_TIER || tier > cxl_region_count) {
+        return -1;
+    }
+    *profile = tier_profiles[tier];
+    return 0;
+}
+
+void cxl_default_config(struct cxl_config *config)
+{
+    config->backend = CXL_BACKEND_DEVDAX;
+    config->path = "/dev/dax0.0";
+    config->max_size = CXL_MAX_SIZE;
+    config->align = CXL_MIN_SIZE;
+    config->numa_nodes = "0";
+    config->region_count = 1;
+    config->latency_ns = 0;
+    config->bandwidth_mbps = 0;
+    config->stats = 0;
+    config->calibrate = 0;
+
+    const char *env = getenv("SIDLE_CXL_BACKEND");
+    if (env != NULL) {
+        if (strcasecmp(env, "devdax") == 0) {
+            config->backend = CXL_BACKEND_DEVDAX;
+        } else if (strcasecmp(env, "anon") == 0) {
+            config->backend = CXL_BACKEND_ANON;
+        } else if (strcasecmp(env, "file") == 0 || strcasecmp(env, "hugetlbfs") == 0) {
+            config->backend = CXL_BACKEND_FILE;
+        } else if (strcasecmp(env, "numa") == 0) {
+            config->backend = CXL_BACKEND_NUMA;
+        } else {
+            fprintf(stderr, "unknown SIDLE_CXL_BACKEND %s, use devdax\n", env);
+        }
+    }
+    if ((env = getenv("SIDLE_CXL_PATH")) != NULL) {
+        config->path = env;
+    }
+    if ((env = getenv("SIDLE_CXL_SIZE")) != NULL && parse_size(env) != 0) {
+        config->max_size = parse_size(env);
+    }
+    if ((env = getenv("SIDLE_CXL_ALIGN")) != NULL && parse_size(env) != 0) {
+        config->align = parse_size(env);
+    }
+    if ((env = getenv("SIDLE_CXL_NUMA_NODE")) != NULL) {
+        config->numa_nodes = env;
+    }
+    if ((env = getenv("SIDLE_CXL_REGIONS")) != NULL && atoi(env) > 0) {
+        config->region_count = atoi(env);
+    }
+    if ((env = getenv("SIDLE_CXL_LATENCY_NS")) != NULL) {
+        config->latency_ns = (unsigned int)strtoul(env, NULL, 10);
+    }
+    if ((env = getenv("SIDLE_CXL_BANDWIDTH_MBPS")) != NULL) {
+        config->bandwidth_mbps = (unsigned int)strtoul(env, NULL, 10);
+    }
+    if ((env = getenv("SIDLE_CXL_STATS")) != NULL) {
+        config->stats = atoi(env);
+    }
+    if ((env = getenv("SIDLE_CXL_CALIBRATE")) != NULL) {
+        config->calibrate = atoi(env);
+    }
+}
+
+int cxl_set_config(const struct cxl_config *config)
+{
+    if (cxl_initialized) {
+        return -1;
+    }
+    cxl_cfg = *config;
+    if (cxl_cfg.align == 0) {
+        cxl_cfg.align = CXL_MIN_SIZE;
+    }
+    cxl_cfg_ready = 1;
+    return 0;
+}
+
+void cxl_get_config(struct cxl_config *config)
+{
+    if (!cxl_cfg_ready) {
+        cxl_default_config(&cxl_cfg);
+        cxl_cfg_ready = 1;
+    }
+    *config = cxl_cfg;
+}
+
+int cxl_tier_count()
+{
+    return cxl_region_count + 1;
+}
+
+void cxl_emulate_access_slow(const void *ptr, size_t size)
+{
+    if (cxl_tier_of(ptr) == CXL_LOCAL_TIER) {
+        return;
+    }
+    uint64_t delay_ns = cxl_cfg.latency_ns;
+    if (cxl_cfg.bandwidth_mbps != 0) {
+        // 1 MB/s moves one byte per 1000 ns
+        delay_ns += size * 1000ULL / cxl_cfg.bandwidth_mbps;
+    }
+    uint64_t deadline = read_cycle() + (uint64_t)(delay_ns * tsc_per_ns);
+    while (read_cycle() < deadline) {
+        __asm__ __volatile__("" ::: "memory");
+    }
+}
+
+// read the usage of jemalloc, both stay 0 if the process is not linked with it
+static void read_malloc_stats(size_t *allocated, size_t *active)
+{
+    if (mallctl == NULL) {
+        return;
+    }
+    // the statistics are a snapshot refreshed by writing the epoch
+    uint64_t epoch = 1;
+    size_t len = sizeof(epoch);
+    mallctl("epoch", &epoch, &len, &epoch, len);
+    size_t allocated_bytes = 0, active_bytes = 0;
+    len = sizeof(size_t);
+    if (mallctl("stats.allocated", &allocated_bytes, &len, NULL, 0) != 0 ||
+        mallctl("stats.active", &active_bytes, &len, NULL, 0) != 0) {
+        return;
+    }
+    *allocated = allocated_bytes;
+    *active = active_bytes;
+}
+
+void cxl_set_local_stats_hook(void (*hook)(struct cxl_tier_stats *stats))
+{
+    local_stats_hook = hook;
+}
+
+int cxl_get_tier_stats(int tier, struct cxl_tier_stats *stats)
+{
+    if (tier < CXL_LOCAL_TIER || tier > cxl_region_count) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    size_t alloc_bytes = 0, free_bytes = 0;
+    size_t class_free[CXL_STATS_SIZE_CLASSES] = {0};
+    for (struct stats_block *block = atomic_load(&stats_blocks); block != NULL; block = block->next) {
+        struct tier_counters *counters = &block->tiers[tier];
+        stats->alloc_count += atomic_load_explicit(&counters->alloc_count, memory_order_relaxed);
+        stats->free_count += atomic_load_explicit(&counters->free_count, memory_order_relaxed);
+        alloc_bytes += atomic_load_explicit(&counters->alloc_bytes, memory_order_relaxed);
+        free_bytes += atomic_load_explicit(&counters->free_bytes, memory_order_relaxed);
+        for (int i = 0; i < CXL_STATS_SIZE_CLASSES; ++i) {
+            stats->class_count[i] += atomic_load_explicit(&counters->class_alloc[i], memory_order_relaxed);
+            class_free[i] += atomic_load_explicit(&counters->class_free[i], memory_order_relaxed);
+        }
+    }
+    // the counters of different threads are read at different times, clamp the transient underflow
+    stats->live_bytes = alloc_bytes > free_bytes ? alloc_bytes - free_bytes : 0;
+    for (int i = 0; i < CXL_STATS_SIZE_CLASSES; ++i) {
+        stats->class_count[i] = stats->class_count[i] > class_free[i] ? stats->class_count[i] - class_free[i] : 0;
+    }
+
+    struct cxl_region *region = region_of_tier(tier);
+    if (region != NULL) {
+        memkind_update_cached_stats();
+        memkind_get_stat(region->kind, MEMKIND_STAT_TYPE_ALLOCATED, &stats->allocated_bytes);
+        memkind_get_stat(region->kind, MEMKIND_STAT_TYPE_ACTIVE, &stats->active_bytes);
+        stats->capacity = region->size;
+    } else {
+        read_malloc_stats(&stats->allocated_bytes, &stats->active_bytes);
+        if (local_stats_hook != NULL) {
+            local_stats_hook(stats);
+        }
+    }
+    if (stats->active_bytes != 0) {
+        stats->fragmentation = 1.0 - (double)stats->allocated_bytes / (double)stats->active_bytes;
+    }
+    return 0;
+}
+
+void cxl_dump_stats(FILE *out)
+{
+    struct cxl_tier_stats stats;
+    for (int tier = CXL_LOCAL_TIER; tier <= cxl_region_count; ++tier) {
+        cxl_get_tier_stats(tier, &stats);
+        fprintf(out, "[cxl stats] tier %d (%s): allocs %lu, frees %lu, live %lu KiB, allocated %lu KiB, "
+                "active %lu KiB, capacity %lu MiB, fragmentation %.3f\n",
+                tier, tier == CXL_LOCAL_TIER ? "local" : backend_name(cxl_cfg.backend),
+                stats.alloc_count, stats.free_count, stats.live_bytes >> 10, stats.allocated_bytes >> 10,
+                stats.active_bytes >> 10, stats.capacity >> 20, stats.fragmentation);
+        if (!stats_enabled) {
+            continue;
+        }
+        fprintf(out, "[cxl stats] tier %d live allocations per size class:", tier);
+        for (int i = 0; i < CXL_STATS_SIZE_CLASSES; ++i) {
+            if (stats.class_count[i] != 0) {
+                fprintf(out, " %s%luB:%lu", i == CXL_STATS_SIZE_CLASSES - 1 ? ">" : "<=",
+                        i == CXL_STATS_SIZE_CLASSES - 1 ? 16UL << (i - 1) : 16UL << i, stats.class_count[i]);
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
+
+void exit_handler(int singal_num) {
+    for (int i = 0; i < cxl_region_count; ++i) {
+        struct cxl_region *region = &cxl_regions[i];
+        if (region->kind != NULL) {
+            int err = memkind_destroy_kind(region->kind);
+            if (err) {
+                print_err_message(err);
+            }   
+        }
+
+        // tear down mmap
+        if (munmap(region->start, region->reserved_size) == -1) {
+            fprintf(stderr, "tear down mmap fail\n");
+            exit(EXIT_FAILURE);
+        }
+        if (region->fd >= 0) {
+            close(region->fd);
+        }
+    }
 }
 
 // inline enum DEVICE_TYPE
@@ -105,35 +889,85 @@ enum DEVICE_TYPE stride_scheduler() {
 void 
 cxl_init(const size_t wanted_size, const int percentage) {   
     // if the cxl device is already initialized, return   
-    if (cxl_fd != 0) {
+    if (cxl_initialized) {
         return;
     }
+    cxl_initialized = 1;
+    if (!cxl_cfg_ready) {
+        cxl_default_config(&cxl_cfg);
+        cxl_cfg_ready = 1;
+    }
 
-    // open the cxl file
-    cxl_fd = open(path, O_RDWR);
-    if (cxl_fd < 0) {
-        fprintf(stderr, "the path for cxl /dev/dax0.0 not exist\n");
+    // decide the regions, the devdax and file backends map one region per path,
+    // the numa backend one region per node
+    static char list_buffer[4096];
+    char *items[CXL_MAX_REGIONS];
+    int region_count = 0;
+    switch (cxl_cfg.backend) {
+    case CXL_BACKEND_DEVDAX:
+    case CXL_BACKEND_FILE:
+        snprintf(list_buffer, sizeof(list_buffer), "%s", cxl_cfg.path);
+        region_count = split_list(list_buffer, items, CXL_MAX_REGIONS);
+        break;
+    case CXL_BACKEND_NUMA:
+        snprintf(list_buffer, sizeof(list_buffer), "%s", cxl_cfg.numa_nodes);
+        region_count = split_list(list_buffer, items, CXL_MAX_REGIONS);
+        break;
+    default:
+        region_count = cxl_cfg.region_count > CXL_MAX_REGIONS ? CXL_MAX_REGIONS : cxl_cfg.region_count;
+        break;
+    }
+    if (region_count <= 0) {
+        fprintf(stderr, "no region is configured for cxl\n");
         exit(EXIT_FAILURE);
     }
 
-    // create the mmap area
-    cxl_current_size = wanted_size > CXL_MAX_SIZE ? CXL_MAX_SIZE : wanted_size;
-    cxl_current_size = cxl_current_size < CXL_MIN_SIZE ? CXL_MIN_SIZE : cxl_current_size;
-    void *mapped_memory = mmap(NULL, cxl_current_size, PROT_READ | PROT_WRITE, MAP_SHARED, cxl_fd, 0);
-    if (mapped_memory == MAP_FAILED) {
-        perror("CXL init error");
-        exit(EXIT_FAILURE);
+    // the wanted size is split evenly among the regions
+    size_t region_size = wanted_size / region_count;
+    region_size = region_size > cxl_cfg.max_size ? cxl_cfg.max_size : region_size;
+    region_size = region_size < cxl_cfg.align ? cxl_cfg.align : region_size;
+    region_size = round_up(region_size, cxl_cfg.align);
+
+    for (int i = 0; i < region_count; ++i) {
+        struct cxl_region *region = &cxl_regions[i];
+        region->size = region_size;
+        region->fd = -1;
+        if (cxl_cfg.backend == CXL_BACKEND_DEVDAX || cxl_cfg.backend == CXL_BACKEND_FILE) {
+            region->fd = open_region_file(items[i], region_size);
+            // a backing file grows with the extents until the file system is full
+            region->device_size = cxl_cfg.backend == CXL_BACKEND_DEVDAX ? devdax_size(region->fd, region_size)
+                                                                         : SIZE_MAX;
+        } else if (cxl_cfg.backend == CXL_BACKEND_NUMA) {
+            region->numa_node = atoi(items[i]);
+        }
+        if (map_region(region, i + 1) != 0) {
+            perror("CXL init error");
+            exit(EXIT_FAILURE);
+        }
+
+        // create the cxl partition with specific size
+        int err = memkind_create_fixed(region->start, region->size, &region->kind);
+        if (err) {
+            print_err_message(err);
+            exit(EXIT_FAILURE);
+        }
+        cxl_region_count = i + 1;
+        printf("[DEBUG] cxl backend: %s, region %d, mmap start point: %p, mmap end point: %p\n",
+               backend_name(cxl_cfg.backend), i, region->start, region->start + region->size);
     }
-    mmap_start_point = (char *)mapped_memory;
-    mmap_end_point = mmap_start_point + cxl_current_size;
-    printf("[DEBUG] mmap start point: %p, mmap end point: %p\n", mmap_start_point, mmap_end_point);
 
-    // create the cxl partition with specific size
-    int err = memkind_create_fixed(mapped_memory, cxl_current_size, &cxl_kind);
-    if (err) {
-        print_err_message(err);
-        exit(EXIT_FAILURE);
+    // the emulated cost is charged by a busy wait on the cycle counter
+    if (cxl_cfg.latency_ns != 0 || cxl_cfg.bandwidth_mbps != 0) {
+        calibrate_cycle_counter();
+        cxl_access_emulation = 1;
+        printf("[DEBUG] cxl emulation: latency %u ns, bandwidth %u MB/s\n",
+               cxl_cfg.latency_ns, cxl_cfg.bandwidth_mbps);
+    }
+
+    if (cxl_cfg.calibrate) {
+        calibrate_tiers();
     }
+    stats_enabled = cxl_cfg.stats != 0;
 
     if (percentage >= 100) {
         percentage_on_cxl = 100;
@@ -166,19 +1000,20 @@ cxl_init(const size_t wanted_size, const int percentage) {
 void* malloc_with_cxl(size_t size) {
     void *result = NULL;
     enum DEVICE_TYPE dev_type = UNKNOWN_DEV;
-    if (cxl_kind != NULL) {
+    if (cxl_region_count > 0) {
         dev_type = stride_scheduler();
         if (dev_type == CXL_DEV) {
-            result = memkind_malloc(cxl_kind, size);
+            result = region_malloc(size);
             if (result != NULL) {
                 return result;
             }
         }
     }
     result = malloc(size);
+    record_stats(result, 0);
     // if malloc fail, try to re-malloc in cxl
     if (result == NULL && dev_type != CXL_DEV) {
-        result = memkind_malloc(cxl_kind, size);
+        result = region_malloc(size);
     }
     return result;
 }
@@ -186,41 +1021,48 @@ void* malloc_with_cxl(size_t size) {
 void* calloc_with_cxl(size_t num, size_t size) {   
     void *result = NULL;
     enum DEVICE_TYPE dev_type = UNKNOWN_DEV;
-    if (cxl_kind != NULL) {
+    if (cxl_region_count > 0) {
         dev_type = stride_scheduler();
         if (dev_type == CXL_DEV) {
-            result = memkind_calloc(cxl_kind, num, size);
+            result = region_calloc(num, size);
             if (result != NULL) {
                 return result;
             }
         }
     }
     result = calloc(num, size);
+    record_stats(result, 0);
     // if malloc fail, try to re-malloc in cxl
     if (result == NULL && dev_type != CXL_DEV) {
-        result = memkind_calloc(cxl_kind, num, size);
+        result = region_calloc(num, size);
     }
     return result;
 }
 
 void* realloc_with_cxl(void *ptr, size_t new_size) {
     void *result = NULL;
-    if ((char *)ptr >= mmap_start_point && (char *)ptr < mmap_end_point) { 
-        result = memkind_realloc(cxl_kind, ptr, new_size);
+    struct cxl_region *region = region_of_tier(cxl_tier_of(ptr));
+    record_stats(ptr, 1);
+    if (region != NULL) { 
+        result = memkind_realloc(region->kind, ptr, new_size);
     } else {
         result = realloc(ptr, new_size);
     }
     // if realloc on the same kind fabric fail, return null ptr
     if (!result) {
         fprintf(stderr, "[realloc_with_cxl] realloc fail\n");
+        record_stats(ptr, 0);
     }
+    record_stats(result, 0);
     return result;
 }
 
 void free_with_cxl(void *ptr) {   
     // allocate in mmap area (cxl)
-    if ((char *)ptr >= mmap_start_point && (char *)ptr < mmap_end_point) {
-        memkind_free(cxl_kind, ptr);
+    struct cxl_region *region = region_of_tier(cxl_tier_of(ptr));
+    record_stats(ptr, 1);
+    if (region != NULL) {
+        memkind_free(region->kind, ptr);
     } else {
         // allocate in heap
         free(ptr);
@@ -230,10 +1072,10 @@ void free_with_cxl(void *ptr) {
 // only mmap the cxl part, if shouldn't mmap on cxl, return mmap fail
 void* mmap_with_cxl(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
     void *result = NULL;
-    if (cxl_kind != NULL && stride_scheduler() == CXL_DEV) {
+    if (cxl_region_count > 0 && stride_scheduler() == CXL_DEV) {
         // should mmap CXL memory
-        result = mmap(addr, length, prot, flags | MAP_SHARED, cxl_fd, cxl_offset);
-        atomic_fetch_add(&cxl_offset, length);
+        result = map_region_extent(region_at(0), length, prot, flags);
+        ++region_cursor;
         if (result == MAP_FAILED) {
             perror("mmap on cxl fail");
         }
@@ -247,17 +1089,35 @@ void* mmap_with_cxl(void *addr, size_t length, int prot, int flags, int fd, off_
 
 void munmap_with_cxl(void * const ptr, const size_t size) 
 {   
-    munmap(ptr, size);
+    struct cxl_region *region = region_of_tier(cxl_tier_of(ptr));
+    if (region == NULL) {
+        munmap(ptr, size);
+        return;
+    }
+    // the extent keeps its address and device range for the next map, the range is never given back
+    // so that a later MAP_FIXED on it can not hit another mapping
+    mtx_lock(&region->extent_mtx);
+    struct cxl_extent *extent = region->extents;
+    while (extent != NULL && extent->start != (char *)ptr) {
+        extent = extent->next;
+    }
+    if (extent != NULL) {
+        reserve_range(extent->start, extent->capacity);
+        extent->free = 1;
+    } else {
+        reserve_range(ptr, size);
+    }
+    mtx_unlock(&region->extent_mtx);
 }
 
 int posix_memalign_with_cxl(void **memptr, size_t alignment, size_t size) {
     enum DEVICE_TYPE dev_type = UNKNOWN_DEV;
     int result = -1;
-    if (cxl_kind != NULL) {
+    if (cxl_region_count > 0) {
         dev_type = stride_scheduler();
         if (dev_type == CXL_DEV) {
             // memalign on CXL memory
-            result = memkind_posix_memalign(cxl_kind, memptr, alignment, size);
+            result = region_posix_memalign(memptr, alignment, size);
             if (result == 0) {
                 return result;
             }
@@ -266,34 +1126,42 @@ int posix_memalign_with_cxl(void **memptr, size_t alignment, size_t size) {
 
     // memalign on local memory
     result = posix_memalign(memptr, alignment, size);
-    if (result != 0 && dev_type != CXL_DEV) {
-        result = memkind_posix_memalign(cxl_kind, memptr, alignment, size);
+    if (result == 0) {
+        record_stats(*memptr, 0);
+    } else if (dev_type != CXL_DEV) {
+        result = region_posix_memalign(memptr, alignment, size);
     }
     return result;
 }
 
 int malloc_on_cxl(size_t size, void **ptr) {
-    *ptr = memkind_malloc(cxl_kind, size);
+    *ptr = region_malloc(size);
     if (*ptr != NULL) {
         return 1;
     }
     *ptr = malloc(size);
+    record_stats(*ptr, 0);
     return 0;
 }
 
 int calloc_on_cxl(size_t num, size_t size, void **ptr) {
-    *ptr = memkind_calloc(cxl_kind, num, size);
+    *ptr = region_calloc(num, size);
     if (*ptr != NULL) {
         return 1;
     }
     *ptr = calloc(num, size);
+    record_stats(*ptr, 0);
     return 0;
 }
 
 int mmap_on_cxl(void *addr, size_t length, int prot, int flags, int fd, off_t offset, void **ptr) {
-    length = (length + CXL_MIN_SIZE - 1) / CXL_MIN_SIZE * CXL_MIN_SIZE;
-    *ptr = mmap(addr, length, prot, flags | MAP_SHARED, cxl_fd, cxl_offset);
-    atomic_fetch_add(&cxl_offset, length);
+    length = round_up(length, cxl_cfg.align);
+    if (cxl_region_count == 0) {
+        *ptr = MAP_FAILED;
+    } else {
+        *ptr = map_region_extent(region_at(0), length, prot, flags);
+        ++region_cursor;
+    }
     if (*ptr == MAP_FAILED) {
         perror("mmap on cxl fail");
         *ptr = mmap(addr, length, prot, flags, fd, offset);
@@ -303,11 +1171,41 @@ int mmap_on_cxl(void *addr, size_t length, int prot, int flags, int fd, off_t of
 }
 
 int posix_memalign_on_cxl(void **memptr, size_t alignment, size_t size) {
-    int result = memkind_posix_memalign(cxl_kind, memptr, alignment, size);
+    int result = region_posix_memalign(memptr, alignment, size);
     // printf("[DEBUG] posix_memalign_on_cxl, result: %p\n", *memptr);
     if (result != 0 && size != 0) {
         // perror("posix_memalign on cxl fail");
         result = posix_memalign(memptr, alignment, size);
+        if (result == 0) {
+            record_stats(*memptr, 0);
+        }
+    }
+    return result;
+}
+
+int malloc_on_tier(int tier, size_t size, void **ptr) {
+    struct cxl_region *region = region_of_tier(tier);
+    if (region != NULL) {
+        *ptr = memkind_malloc(region->kind, size);
+        if (*ptr != NULL) {
+            record_stats(*ptr, 0);
+            return 1;
+        }
+    }
+    *ptr = malloc(size);
+    record_stats(*ptr, 0);
+    return tier == CXL_LOCAL_TIER;
+}
+
+int posix_memalign_on_tier(int tier, void **memptr, size_t alignment, size_t size) {
+    struct cxl_region *region = region_of_tier(tier);
+    if (region != NULL && memkind_posix_memalign(region->kind, memptr, alignment, size) == 0) {
+        record_stats(*memptr, 0);
+        return 0;
+    }
+    int result = posix_memalign(memptr, alignment, size);
+    if (result == 0) {
+        record_stats(*memptr, 0);
     }
     return result;
 }
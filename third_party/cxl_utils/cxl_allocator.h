@@ -1,11 +1,194 @@
 #ifndef CXL_ALLOCATOR_H
 #define CXL_ALLOCATOR_H
 
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// default size of the CXL tier, overridden by cxl_config::max_size
 static const size_t CXL_MAX_SIZE = 1024ULL * 1024ULL * 1024ULL * 30ULL;
+/// default mapping granularity of the CXL tier, overridden by cxl_config::align
+static const size_t CXL_MIN_SIZE = 2ULL * 1024ULL * 1024ULL;
+
+/// the maximum number of CXL regions (devices or emulated regions)
+#define CXL_MAX_REGIONS 8
+/// the tier of local DRAM, the CXL region i is the tier i + 1
+#define CXL_LOCAL_TIER 0
+/// every region is mapped at a 1 GiB boundary and padded to 1 GiB, so one map entry per 1 GiB classifies an address
+#define CXL_TIER_GRANULE_SHIFT 30
+#define CXL_TIER_MAP_SIZE (1UL << (47 - CXL_TIER_GRANULE_SHIFT))
+/// the size classes of cxl_tier_stats, class 0 counts usable sizes up to 16 bytes, class i up to 16 << i
+/// bytes and the last class everything larger
+#define CXL_STATS_SIZE_CLASSES 16
+
+/**
+ * @brief The memory backing the CXL tier
+ */
+enum cxl_backend_type {
+    CXL_BACKEND_DEVDAX,     // a real CXL device exposed as a devdax character device
+    CXL_BACKEND_ANON,       // an anonymous mapping in local DRAM, useful without CXL hardware
+    CXL_BACKEND_FILE,       // a file mapping, e.g. a file on a hugetlbfs mount
+    CXL_BACKEND_NUMA        // an anonymous mapping bound to a (memory-only) NUMA node
+};
+
+/**
+ * @brief Runtime configuration of the CXL tier, must be set before cxl_init
+ * @note Every field can be overridden by an environment variable (see cxl_default_config)
+ */
+struct cxl_config {
+    enum cxl_backend_type backend;
+    const char *path;               // devdax devices or backing files, comma-separated for several regions
+    size_t max_size;                // upper bound of the mapped size of each region
+    size_t align;                   // mapping granularity, e.g. the devdax align or the huge page size
+    const char *numa_nodes;         // target nodes of the numa backend, one region per node, e.g. "2,3"
+    int region_count;               // number of regions of the anon backend
+    unsigned int latency_ns;        // extra latency charged per emulated remote access, 0 disables it
+    unsigned int bandwidth_mbps;    // emulated remote bandwidth in MB/s, 0 means unlimited
+    int stats;                      // non-zero to count the allocations per tier, see cxl_get_tier_stats
+    int calibrate;                  // non-zero to probe the latency and bandwidth of every tier in cxl_init
+};
+
+/**
+ * @brief The measured performance of a tier, see cxl_config::calibrate
+ * @note The profile of an emulated region includes the configured latency and bandwidth emulation
+ */
+struct tier_profile {
+    int valid;                      // non-zero once the tier has been probed
+    double latency_ns;              // average latency of a dependent load, from a random pointer chase
+    double read_bandwidth_mbps;     // sequential read bandwidth of one thread
+    double write_bandwidth_mbps;    // sequential write bandwidth of one thread
+};
+
+/**
+ * @brief The allocation statistics of a tier
+ * @note The counters only cover the memory allocated through this allocator after cxl_init with stats
+ *       enabled, while allocated_bytes and active_bytes come from the allocator behind the tier
+ *       (memkind for a CXL region, the libc heap of the whole process for local memory)
+ */
+struct cxl_tier_stats {
+    size_t alloc_count;                             // allocations served by the tier
+    size_t free_count;                              // frees returned to the tier
+    size_t live_bytes;                              // usable bytes of the live allocations
+    size_t class_count[CXL_STATS_SIZE_CLASSES];     // live allocations per size class of the usable size
+    size_t allocated_bytes;                         // bytes the allocator hands out, jemalloc plus the local stats hook for local memory
+    size_t active_bytes;                            // bytes of the pages the allocator keeps active, 0 if unknown
+    size_t capacity;                                // mapped size of a CXL region, 0 for local memory
+    double fragmentation;                           // 1 - allocated_bytes / active_bytes
+};
+
+/**
+ * @brief Fill the config with the built-in defaults, then apply the environment overrides
+ * @param config The config to fill
+ * @note Recognized variables: SIDLE_CXL_BACKEND (devdax|anon|file|numa), SIDLE_CXL_PATH,
+ *       SIDLE_CXL_SIZE, SIDLE_CXL_ALIGN (both accept K/M/G suffixes), SIDLE_CXL_NUMA_NODE,
+ *       SIDLE_CXL_REGIONS, SIDLE_CXL_LATENCY_NS, SIDLE_CXL_BANDWIDTH_MBPS, SIDLE_CXL_STATS and
+ *       SIDLE_CXL_CALIBRATE
+ */
+extern void
+cxl_default_config(struct cxl_config *config);
+
+/**
+ * @brief Set the config used by the next cxl_init
+ * @param config The config to use
+ * @return 0 on success, -1 if the CXL tier is already initialized
+ */
+extern int
+cxl_set_config(const struct cxl_config *config);
+
+/**
+ * @brief Get the config of the CXL tier
+ * @param config The config to fill
+ */
+extern void
+cxl_get_config(struct cxl_config *config);
+
+/// the tier of every 1 GiB granule of the address space, read by cxl_tier_of
+extern unsigned char cxl_tier_map[CXL_TIER_MAP_SIZE];
+
+/**
+ * @brief Classify an address in O(1)
+ * @param ptr The address
+ * @return CXL_LOCAL_TIER for local memory, i + 1 for the CXL region i
+ */
+static inline int
+cxl_tier_of(const void *ptr)
+{
+    size_t granule = (size_t)ptr >> CXL_TIER_GRANULE_SHIFT;
+    return granule < CXL_TIER_MAP_SIZE ? cxl_tier_map[granule] : CXL_LOCAL_TIER;
+}
+
+/**
+ * @brief Get the number of tiers
+ * @return 1 (local DRAM) plus the number of CXL regions
+ */
+extern int
+cxl_tier_count();
+
+/**
+ * @brief Get the allocation statistics of a tier
+ * @param tier CXL_LOCAL_TIER or the tier of a CXL region
+ * @param stats The statistics to fill
+ * @return 0 on success, -1 if the tier does not exist
+ * @note The counters stay zero unless stats is enabled in the config. The usage of the local tier is
+ *       read from jemalloc and stays zero if the process is not linked with it
+ */
+extern int
+cxl_get_tier_stats(int tier, struct cxl_tier_stats *stats);
+
+/**
+ * @brief Set a hook that adds the local memory served outside malloc to the local tier statistics
+ * @param hook Called by cxl_get_tier_stats after the malloc usage is filled in, NULL to remove it
+ */
+extern void
+cxl_set_local_stats_hook(void (*hook)(struct cxl_tier_stats *stats));
+
+/**
+ * @brief Get the measured performance of a tier
+ * @param tier CXL_LOCAL_TIER or the tier of a CXL region
+ * @param profile The profile to fill, profile->valid is 0 if calibration is disabled
+ * @return 0 on success, -1 if the tier does not exist
+ */
+extern int
+cxl_get_tier_profile(int tier, struct tier_profile *profile);
+
+/**
+ * @brief Print the statistics of every tier
+ * @param out The stream to print to
+ */
+extern void
+cxl_dump_stats(FILE *out);
+
+/// non-zero when latency or bandwidth emulation is enabled, read by cxl_emulate_access
+extern int cxl_access_emulation;
+
+/**
+ * @brief Charge the configured latency and bandwidth cost if ptr lives in the CXL tier
+ * @param ptr The accessed address
+ * @param size The number of bytes accessed
+ */
+extern void
+cxl_emulate_access_slow(const void *ptr, size_t size);
+
+/**
+ * @brief Emulate a remote access on the read path, free when the emulation is disabled
+ * @param ptr The accessed address
+ * @param size The number of bytes accessed
+ */
+static inline void
+cxl_emulate_access(const void *ptr, size_t size)
+{
+    if (__builtin_expect(cxl_access_emulation, 0)) {
+        cxl_emulate_access_slow(ptr, size);
+    }
+}
 
 /**
  * @brief Initialize the CXL memory allocator
- * @param wanted_size The desired size of CXL memory 
+ * @param wanted_size The desired size of CXL memory, clamped into [align, max_size] of the config
  * @param percentage The percentage of CXL memory to use
  */
 extern void 
@@ -46,19 +229,20 @@ free_with_cxl(void *ptr);
 
 /**
  * @brief Map memory on CXL or DRAM, similar to standard mmap
- * @param addr Suggested mapping address
+ * @param addr Suggested mapping address, ignored on CXL: the mapping reuses an unmapped one or starts past the last
  * @param length Length of mapping
  * @param prot Memory protection flags
  * @param flags Mapping flags
  * @param fd File descriptor
  * @param offset File offset
- * @return Pointer to mapped memory, MAP_FAILED if mapping fails
+ * @return Pointer to mapped memory, MAP_FAILED if mapping fails, with errno ENOMEM once the device is full
  */
 extern void *
 mmap_with_cxl(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
 
 /**
- * @brief Unmap memory previously mapped with mmap_with_cxl
+ * @brief Unmap memory previously mapped with mmap_with_cxl or mmap_on_cxl. A CXL mapping keeps its address and
+ *        device range for a later map of at most the same size
  * @param ptr Pointer to memory to be unmapped
  * @param size Size of memory region to unmap
  */
@@ -82,7 +266,7 @@ extern void
 cxl_destroy();
 
 /**
- * @brief Try to allocate memory on CXL
+ * @brief Try to allocate memory on CXL, interleaving the CXL regions
  * @param size Size of memory to allocate
  * @param ptr Address to store allocated memory pointer
  * @return true if allocation succeeds, false otherwise
@@ -102,7 +286,7 @@ calloc_on_cxl(size_t num, size_t size, void **ptr);
 
 /**
  * @brief Try to mmap CXL memory
- * @param addr Suggested mapping address
+ * @param addr Suggested mapping address, ignored on CXL: the mapping reuses an unmapped one or starts past the last
  * @param length Length of mapping
  * @param prot Memory protection flags
  * @param flags Mapping flags (should be MAP_SHARED)
@@ -124,4 +308,30 @@ mmap_on_cxl(void *addr, size_t length, int prot, int flags, int fd, off_t offset
 extern int
 posix_memalign_on_cxl(void **memptr, size_t alignment, size_t size);
 
-#endif  // CXL_ALLOCATOR_H
\ No newline at end of file
+/**
+ * @brief Try to allocate memory on a specific tier
+ * @param tier CXL_LOCAL_TIER or the tier of a CXL region
+ * @param size Size of memory to allocate
+ * @param ptr Address to store allocated memory pointer
+ * @return true if the memory is on the requested tier, false if it falls back to local memory
+ */
+extern int
+malloc_on_tier(int tier, size_t size, void **ptr);
+
+/**
+ * @brief Try to allocate aligned memory on a specific tier
+ * @param tier CXL_LOCAL_TIER or the tier of a CXL region
+ * @param memptr Address to store allocated memory pointer
+ * @param alignment Alignment requirement
+ * @param size Size to allocate
+ * @return 0 on success, error code on failure
+ * @note falls back to local memory like posix_memalign_on_cxl
+ */
+extern int
+posix_memalign_on_tier(int tier, void **memptr, size_t alignment, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CXL_ALLOCATOR_H
@@ -1,12 +1,119 @@
 #include "cxl_cpp_allocator.hh"
 
+#include <cstring>
+
+namespace cxl {
+
+// -1 means no guard is active and the process default applies, a constant initializer keeps the
+// access free of TLS wrappers inside operator new
+static thread_local int8_t scoped_placement = -1;
+
+static placement default_placement()
+{
+    static const placement result = []() {
+        const char* env = getenv("SIDLE_CXX_PLACEMENT");
+        if (env == nullptr || strcmp(env, "local") == 0) {
+            return placement::local;
+        }
+        if (strcmp(env, "ratio") == 0) {
+            return placement::ratio;
+        }
+        if (strcmp(env, "remote") == 0) {
+            return placement::remote;
+        }
+        fprintf(stderr, "unknown SIDLE_CXX_PLACEMENT %s, use local\n", env);
+        return placement::local;
+    }();
+    return result;
+}
+
+placement current_placement()
+{
+    return scoped_placement < 0 ? default_placement() : static_cast<placement>(scoped_placement);
+}
+
+placement_guard::placement_guard(placement p) : prev_(scoped_placement)
+{
+    scoped_placement = static_cast<int8_t>(p);
+}
+
+placement_guard::~placement_guard()
+{
+    scoped_placement = prev_;
+}
+
+void* tier_memory_resource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        malloc_on_tier(tier_, bytes, &p);
+    } else if (posix_memalign_on_tier(tier_, &p, alignment, bytes) != 0) {
+        p = nullptr;
+    }
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void tier_memory_resource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+{
+    (void)bytes;
+    (void)alignment;
+    free_with_cxl(p);
+}
+
+bool tier_memory_resource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    const tier_memory_resource* o = dynamic_cast<const tier_memory_resource*>(&other);
+    return o != nullptr && o->tier_ == tier_;
+}
+
+std::pmr::memory_resource* tier_resource(int tier)
+{
+    static_assert(CXL_MAX_REGIONS == 8, "one resource per tier");
+    static tier_memory_resource resources[CXL_MAX_REGIONS + 1] = {
+        tier_memory_resource(0), tier_memory_resource(1), tier_memory_resource(2),
+        tier_memory_resource(3), tier_memory_resource(4), tier_memory_resource(5),
+        tier_memory_resource(6), tier_memory_resource(7), tier_memory_resource(8)};
+    if (tier < CXL_LOCAL_TIER || tier > CXL_MAX_REGIONS) {
+        return nullptr;
+    }
+    return &resources[tier];
+}
+
+}  // namespace cxl
+
+// every allocation stays in DRAM unless the thread asks for CXL with a cxl::placement_guard,
+// index nodes and values are placed by their own allocators
+static inline void* placed_malloc(std::size_t size)
+{
+    void* p = nullptr;
+    switch (cxl::current_placement()) {
+    case cxl::placement::ratio:
+        p = malloc_with_cxl(size);
+        break;
+    case cxl::placement::remote:
+        malloc_on_cxl(size, &p);
+        break;
+    default:
+        // the same as malloc, but seen by the allocation counters like the frees of operator delete
+        malloc_on_tier(CXL_LOCAL_TIER, size, &p);
+        break;
+    }
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
 void *
 operator new(std::size_t size)
 {
     #ifdef CXL
-    malloc_with_cxl(size);
+    return placed_malloc(size);
     #else
-    ::operator new(size);
+    return ::operator new(size);
     #endif
 }
 
@@ -14,9 +121,9 @@ void *
 operator new[](std::size_t size)
 {
     #ifdef CXL
-    malloc_with_cxl(size);
+    return placed_malloc(size);
     #else
-    ::operator new[](size);
+    return ::operator new[](size);
     #endif
 }
 
@@ -38,4 +145,4 @@ operator delete[](void* ptr) noexcept
     #else
     ::operator delete[](ptr);
     #endif
-}
\ No newline at end of file
+}
@@ -8,7 +8,9 @@
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
 #include <iostream>
+#include <memory_resource>
 #include <new>
 #include <memkind.h>
 
@@ -18,6 +20,64 @@ extern "C" {
 
 #define CXL 1
 
+namespace cxl {
+
+/**
+ * @brief Where the global operator new of a thread places its allocations
+ */
+enum class placement : uint8_t {
+    local = 0,      // local DRAM, the default for everything but index nodes and values
+    ratio,          // CXL or DRAM by the ratio of cxl_init, like malloc_with_cxl
+    remote          // CXL, falls back to DRAM when CXL is exhausted
+};
+
+/**
+ * @brief Get the placement of operator new on the calling thread
+ * @note The process default is local, SIDLE_CXX_PLACEMENT=local|ratio|remote overrides it
+ */
+placement current_placement();
+
+/**
+ * @brief Place the operator new allocations of the calling thread for the lifetime of the guard
+ * @note Guards nest, the destructor restores the enclosing placement
+ */
+class placement_guard {
+public:
+    explicit placement_guard(placement p);
+    ~placement_guard();
+    placement_guard(const placement_guard&) = delete;
+    placement_guard& operator=(const placement_guard&) = delete;
+
+private:
+    int8_t prev_;
+};
+
+/**
+ * @brief A memory resource allocating on one tier, for containers whose placement should not
+ *        depend on the calling thread, e.g. std::pmr::vector<T> v(cxl::tier_resource(1))
+ */
+class tier_memory_resource : public std::pmr::memory_resource {
+public:
+    explicit tier_memory_resource(int tier) : tier_(tier) {}
+    int tier() const { return tier_; }
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    int tier_;
+};
+
+/**
+ * @brief Get the memory resource of a tier
+ * @param tier CXL_LOCAL_TIER or the tier of a CXL region
+ * @return A resource living for the whole process
+ */
+std::pmr::memory_resource* tier_resource(int tier);
+
+}  // namespace cxl
+
 extern void * 
 operator new(std::size_t size);
 
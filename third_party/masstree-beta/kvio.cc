@@ -33,19 +33,11 @@
 
 // API to allocate a new kvout.
 kvout* new_kvout(int fd, int buflen) {
-    #ifdef CXL
-    kvout* kv = (kvout*) malloc_with_cxl(sizeof(kvout));
-    #else
     kvout* kv = (kvout*) malloc(sizeof(kvout));
-    #endif
     assert(kv);
     memset(kv, 0, sizeof(*kv));
     kv->capacity = buflen;
-    #ifdef CXL
-    kv->buf = (char*) malloc_with_cxl(kv->capacity);
-    #else
     kv->buf = (char*) malloc(kv->capacity);
-    #endif
     assert(kv->buf);
     kv->fd = fd;
     return kv;
@@ -53,19 +45,11 @@ kvout* new_kvout(int fd, int buflen) {
 
 // API to allocate a new kvout for a buffer, no fd.
 kvout* new_bufkvout() {
-    #ifdef CXL
-    kvout *kv = (kvout*) malloc_with_cxl(sizeof(kvout));
-    #else
     kvout *kv = (kvout*) malloc(sizeof(kvout));
-    #endif
     assert(kv);
     memset(kv, 0, sizeof(*kv));
     kv->capacity = 256;
-    #ifdef CXL
-    kv->buf = (char*) malloc_with_cxl(kv->capacity);
-    #else
     kv->buf = (char*) malloc(kv->capacity);
-    #endif
     assert(kv->buf);
     kv->n = 0;
     kv->fd = -1;
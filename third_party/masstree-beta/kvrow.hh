@@ -38,6 +38,7 @@ typedef value_string row_type;
 # include "value_bag.hh"
 typedef value_bag<uint16_t> row_type;
 #endif
+#include "value_inline.hh"
 
 template <typename R>
 struct query_helper {
@@ -160,8 +161,10 @@ bool query<R>::run_get1(T& table, Str key, int col, Str& value, threadinfo& ti)
     bool found = lp.find_unlocked(ti);
     if (found && row_is_marker(lp.value()))
         found = false;
-    if (found)
+    if (found) {
         value = lp.value()->col(col);
+        cxl_emulate_access(value.data(), value.length());
+    }
     return found;
 }
 
@@ -452,6 +455,36 @@ class proxy_scanner {
     callback_t &cb;
 };
 
+/// @brief hand the rows to a visitor as views of the key and of the first column, valid only
+/// during the call, without building a Json request. The visitor returns false to stop the scan.
+template <typename R, typename F>
+class visitor_scanner {
+  public:
+    visitor_scanner(F& visitor)
+        : visitor_(visitor), count_(0) {
+    }
+    template <typename SS, typename K>
+    void visit_leaf(const SS&, const K&, threadinfo&) {
+    }
+    bool visit_value(Str key, R* value, threadinfo&) {
+        if (row_is_marker(value))
+            return true;
+        ++count_;
+        return visitor_(key, value->col(0));
+    }
+    template <size_t N>
+    bool visit_value(Str key, const value_inline<N>& value, threadinfo&) {
+        ++count_;
+        return visitor_(key, value.col(0));
+    }
+    size_t count() const {
+        return count_;
+    }
+  private:
+    F& visitor_;
+    size_t count_;
+};
+
 template <typename R> template <typename T>
 void query<R>::run_range_scan(T& table, Json& request, threadinfo& ti) {
     f_.clear();
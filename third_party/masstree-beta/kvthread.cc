@@ -14,6 +14,7 @@
  * is legally binding.
  */
 #include "kvthread.hh"
+#include "sidle_slab.hh"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -57,11 +58,7 @@ inline threadinfo::threadinfo(int purpose, int index) {
 
 threadinfo *threadinfo::make(int purpose, int index) {
     static int threads_initialized;
-    #ifdef CXL
-    threadinfo* ti = new(malloc_with_cxl(8192)) threadinfo(purpose, index);
-    #else
     threadinfo* ti = new(malloc(8192)) threadinfo(purpose, index);
-    #endif
     ti->next_ = allthreads;
     allthreads = ti;
 
@@ -314,16 +311,12 @@ void threadinfo::refill_local_pool(int nl) {
             *reinterpret_cast<void**>(pool_[nl - 1]) = 0;
         return;
     }
-    void* pool = 0;
-    size_t pool_size = 0;
-    int r;
-    
+    // local nodes are carved from the huge-page local arena
+    size_t pool_size = sidle::slab_chunk_size;
+    void* pool = sidle::local_arena.allocate_chunk();
     if (!pool) {
-        pool_size = 2 << 20;
-        if ((r = posix_memalign(&pool, CACHE_LINE_SIZE, pool_size)) != 0) {
-            fprintf(stderr, "posix_memalign: %s\n", strerror(r));
-            abort();
-        }
+        fprintf(stderr, "local arena: out of memory\n");
+        abort();
     }
 
     initialize_pool(pool, pool_size, nl * CACHE_LINE_SIZE);
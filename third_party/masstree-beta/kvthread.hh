@@ -218,6 +218,23 @@ class threadinfo {
             mark(threadcounter(tc_alloc + (tag > memtag_value)), sz);
         return p;
     }
+    // allocate on local memory or on CXL instead of where the stride scheduler puts it, for the
+    // values that move along with their leaf. The block is freed by deallocate like any other
+    void* allocate_on(size_t sz, memtag tag, bool remote) {
+        void* p;
+        #ifdef CXL
+        if (remote)
+            malloc_on_cxl(sz + memdebug_size, &p);
+        else
+            malloc_on_tier(CXL_LOCAL_TIER, sz + memdebug_size, &p);
+        #else
+        p = malloc(sz + memdebug_size);
+        #endif
+        p = memdebug::make(p, sz, tag);
+        if (p)
+            mark(threadcounter(tc_alloc + (tag > memtag_value)), sz);
+        return p;
+    }
     void deallocate(void* p, size_t sz, memtag tag) {
         // in C++ allocators, 'p' must be nonnull
         assert(p);
@@ -320,6 +337,9 @@ class threadinfo {
         mark(threadcounter(tc_alloc + (tag > memtag_value)),
              -nl * CACHE_LINE_SIZE);
     }
+    // the largest allocation served by the pools, in cache lines
+    enum { pool_max_nlines = 20 };
+
     void pool_deallocate_rcu(void* p, size_t sz, memtag tag) {
         int nl = (sz + memdebug_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
         assert(p && nl <= pool_max_nlines);
@@ -379,7 +399,6 @@ class threadinfo {
         char padding1[CACHE_LINE_SIZE];
     };
 
-    enum { pool_max_nlines = 20 };
     void* pool_[pool_max_nlines];
     void* remote_pool_[pool_max_nlines];
 
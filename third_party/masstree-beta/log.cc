@@ -188,11 +188,7 @@ loginfo::loginfo(logset* ls, int logindex) {
 
     len_ = 20 * 1024 * 1024;
     pos_ = 0;
-    #ifdef CXL
-    buf_ = (char *) malloc_with_cxl(len_);
-    #else
     buf_ = (char *) malloc(len_);
-    #endif
     always_assert(buf_);
     log_epoch_ = 0;
     quiescent_epoch_ = 0;
@@ -253,11 +249,7 @@ void* loginfo::run() {
     int fd = open(String(f_.filename_).c_str(),
                   O_WRONLY | O_APPEND | O_CREAT, 0666);
     always_assert(fd >= 0);
-    #ifdef CXL
-    char *x_buf = (char *) malloc_with_cxl(len_);
-    #else
     char *x_buf = (char *) malloc(len_);
-    #endif
     always_assert(x_buf);
 
     while (1) {
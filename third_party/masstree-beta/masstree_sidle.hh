@@ -1,10 +1,19 @@
 #ifndef MASSTREE_SIDLE_HH
 #define MASSTREE_SIDLE_HH
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <mutex>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include "sidle_meta.hh"
+#include "sidle_copy.hh"
+#include "sidle_traverse.hh"
 #include "btree_leaflink.hh"
 #include "kvthread.hh"
 #include "masstree.hh"
@@ -45,17 +54,13 @@ uint64_t to_str_order_key(uint64_t value) {
   return value;
 }
 
-template <typename T, typename ...Args>
-void masstree_leaf_traverse(tree_t<T>* tree, masstree_cb<T> cb, Args... args) {
+/// @brief visit the leaves of the layer under root and of the layers below it, in key order
+template <typename T>
+void masstree_layer_traverse(base_node_t<T>* root, const masstree_cb<T>& cb, threadinfo* ti) {
   using leaf_iterator = leaf_iterator<T>;
   using tracker_t = typename leaf_iterator::tracker_t;
-  leaf_iterator it(tree ? tree->root() : nullptr);
+  leaf_iterator it(root);
   uint64_t str_order_key = to_str_order_key(0);
-  threadinfo *ti = nullptr;
-  if constexpr (sizeof...(args) > 0) {
-    auto args_tuple = std::make_tuple(args...);
-    ti = std::get<0>(args_tuple);
-  }
   it.init((char *)&str_order_key, *ti);
   while (it.state() != tracker_t::scan_end) {
     if (!it.node()) {
@@ -67,6 +72,196 @@ void masstree_leaf_traverse(tree_t<T>* tree, masstree_cb<T> cb, Args... args) {
   }
 }
 
+template <typename T, typename ...Args>
+void masstree_leaf_traverse(tree_t<T>* tree, masstree_cb<T> cb, Args... args) {
+  threadinfo *ti = nullptr;
+  if constexpr (sizeof...(args) > 0) {
+    auto args_tuple = std::make_tuple(args...);
+    ti = std::get<0>(args_tuple);
+  }
+  masstree_layer_traverse<T>(tree ? tree->root() : nullptr, cb, ti);
+}
+
+/// @brief the threadinfos of the traversal workers [0, workers), the calling worker 0 brings its
+///        own. They are made as the pool grows across restarts and kept, a threadinfo is never
+///        freed, the caller gets a copy so that a later growth does not move them under its run
+inline std::vector<threadinfo*> masstree_traverse_threadinfos(size_t workers, threadinfo* caller) {
+  static std::mutex mtx;
+  static std::vector<threadinfo*> tis(1, nullptr);
+  std::lock_guard<std::mutex> lock(mtx);
+  while (tis.size() < workers) {
+    tis.push_back(threadinfo::make(threadinfo::TI_MIGRATION, -1));
+  }
+  std::vector<threadinfo*> copy(tis.begin(), tis.begin() + std::max<size_t>(workers, 1));
+  copy[0] = caller;
+  return copy;
+}
+
+/// @brief visit the leaves of the first layer whose lower bound is in [lo, hi), and the layers
+///        below them. A leaf is visited by the range holding its lower bound, the leftmost leaf
+///        by the first range
+template <typename T>
+void masstree_range_traverse(tree_t<T>* tree, uint64_t lo, uint64_t hi, bool first, bool last,
+                             const masstree_cb<T>& cb, threadinfo* ti) {
+  using leaf_type = leaf_node_t<T>;
+  typename leaf_type::key_type ka(lo);
+  typename base_node_t<T>::nodeversion_type v;
+  // the leftmost leaf has no lower bound in ikey0_[0]
+  auto bound_of = [](leaf_type* leaf) { return leaf->prev_ ? leaf->ikey_bound() : 0; };
+  leaf_type* n = tree->root()->reach_leaf(ka, v, *ti);
+  // the leaf holding lo belongs to the range before unless it starts at lo
+  if (!first && bound_of(n) < lo) {
+    n = n->safe_next();
+  }
+  std::vector<base_node_t<T>*> layers;
+  for (; n && (last || bound_of(n) < hi); n = n->safe_next()) {
+    if (n->deleted()) {
+      continue;
+    }
+    do {
+      v = n->stable();
+      auto perm = n->permutation();
+      layers.clear();
+      for (int i = 0; i < perm.size(); ++i) {
+        if (n->is_layer(perm[i])) {
+          layers.push_back(n->lv_[perm[i]].layer());
+        }
+      }
+    } while (n->has_changed(v));
+    cb(nullptr, n);
+    for (base_node_t<T>* layer : layers) {
+      while (!layer->is_root()) {
+        layer = layer->maybe_parent();
+      }
+      masstree_layer_traverse<T>(layer, cb, ti);
+    }
+  }
+}
+
+/// @brief masstree_leaf_traverse on sidle::traverse_workers, which may call back from several
+///        threads at once. The first layer is split into key ranges at the separator keys of
+///        the root and of its internode children, the workers take the ranges in order and
+///        steal the rest, every worker with its own threadinfo
+template <typename T, typename ...Args>
+void masstree_leaf_traverse_mt(tree_t<T>* tree, masstree_cb<T> cb, Args... args) {
+  using internode_type = internode_t<T>;
+  threadinfo *ti = nullptr;
+  if constexpr (sizeof...(args) > 0) {
+    auto args_tuple = std::make_tuple(args...);
+    ti = std::get<0>(args_tuple);
+  }
+  base_node_t<T>* root = tree ? tree->root() : nullptr;
+  while (root && !root->is_root()) {
+    root = root->maybe_parent();
+  }
+  if (!root || root->isleaf() || sidle::traverse_workers.worker_count() <= 1) {
+    // in a read-side section like the workers below
+    if (ti) {
+      ti->rcu_start();
+    }
+    masstree_layer_traverse<T>(root, cb, ti);
+    if (ti) {
+      ti->rcu_stop();
+    }
+    return;
+  }
+
+  // the separators of a node, stale ones only unbalance the ranges
+  std::vector<uint64_t> bounds;
+  std::vector<base_node_t<T>*> children;
+  auto add_separators = [&](internode_type* in, bool with_children) {
+    typename base_node_t<T>::nodeversion_type v;
+    size_t keys = bounds.size(), nodes = children.size();
+    do {
+      bounds.resize(keys);
+      children.resize(nodes);
+      v = in->stable();
+      for (int i = 0; i < in->nkeys_; ++i) {
+        bounds.push_back(in->ikey0_[i]);
+      }
+      for (int i = 0; with_children && i <= in->nkeys_; ++i) {
+        children.push_back(in->child_[i]);
+      }
+    } while (in->has_changed(v));
+  };
+  add_separators(static_cast<internode_type*>(root), true);
+  for (base_node_t<T>* child : children) {
+    if (child && !child->isleaf()) {
+      add_separators(static_cast<internode_type*>(child), false);
+    }
+  }
+  std::sort(bounds.begin(), bounds.end());
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+  size_t ranges = bounds.size() + 1;
+  std::vector<threadinfo*> tis = masstree_traverse_threadinfos(sidle::traverse_workers.worker_count(), ti);
+  auto traverse_range = [&](size_t part, int worker) {
+    // the pool might have been restarted larger since the copy
+    threadinfo* wti = size_t(worker) < tis.size() ? tis[worker]
+                                                  : masstree_traverse_threadinfos(worker + 1, ti)[worker];
+    wti->rcu_start();
+    masstree_range_traverse<T>(tree, part == 0 ? 0 : bounds[part - 1],
+                               part + 1 == ranges ? 0 : bounds[part],
+                               part == 0, part + 1 == ranges, cb, wti);
+    wti->rcu_stop();
+  };
+  sidle::traverse_workers.run_partitions(ranges, traverse_range);
+}
+
+/// @brief values up to this size move along with their leaf, see SIDLE_MASSTREE_VALUE_MIGRATION_CAP
+inline size_t masstree_value_migration_cap = SIZE_MAX;
+
+/// @note set SIDLE_MASSTREE_VALUE_MIGRATION_CAP to the largest value in bytes a migration moves
+///       along with its leaf, 0 to leave every value where it was allocated
+inline void init_value_migration() {
+  const char* env = getenv("SIDLE_MASSTREE_VALUE_MIGRATION_CAP");
+  if (env != nullptr) {
+    masstree_value_migration_cap = strtoull(env, nullptr, 10);
+  }
+}
+
+/// @brief copy the values of a locked leaf that are not on target_type yet into new_node, its copy
+/// @note the row types are flat, a row is copied as its size() bytes
+template <typename T>
+void masstree_migrate_values(leaf_node_t<T>* cur_node, leaf_node_t<T>* new_node,
+                             sidle::node_mem_type target_type, threadinfo& ti) {
+  using row_t = std::remove_pointer_t<typename T::value_type>;
+  bool remote = target_type == node_mem_type::remote;
+  auto perm = cur_node->permutation();
+  for (int i = 0; i < perm.size(); ++i) {
+    int p = perm[i];
+    if (cur_node->is_layer(p)) {
+      continue;
+    }
+    row_t* row = cur_node->lv_[p].value();
+    if (!row || row_is_marker(row) || (cxl_tier_of(row) != CXL_LOCAL_TIER) == remote) {
+      continue;
+    }
+    size_t size = row->size();
+    if (size > masstree_value_migration_cap) {
+      continue;
+    }
+    void* copy = ti.allocate_on(size, memtag_value, remote);
+    if (!copy) {
+      continue;
+    }
+    memcpy(copy, row, size);
+    new_node->lv_[p] = static_cast<row_t*>(copy);
+  }
+}
+
+/// @brief retire the values of a replaced leaf that were moved to its copy
+template <typename T>
+void masstree_retire_values(leaf_node_t<T>* cur_node, leaf_node_t<T>* new_node, threadinfo& ti) {
+  auto perm = cur_node->permutation();
+  for (int i = 0; i < perm.size(); ++i) {
+    int p = perm[i];
+    if (!cur_node->is_layer(p) && cur_node->lv_[p].value() != new_node->lv_[p].value()) {
+      cur_node->lv_[p].value()->deallocate_rcu(ti);
+    }
+  }
+}
+
 /// @return the parent node
 template <typename T, typename ...Args>
 internode_t<T>* masstree_leaf_migration(leaf_node_t<T>* cur_node, internode_t<T>* parent, sidle::node_mem_type target_type, Args... args) {
@@ -84,7 +279,9 @@ internode_t<T>* masstree_leaf_migration(leaf_node_t<T>* cur_node, internode_t<T>
   if (cur_node->deleted()) {
     return nullptr;
   }
-  if (cur_node->sidle_meta.metadata.type == target_type) {
+  // a node on the target tier is only relocated by the compactor, out of a chunk under evacuation
+  bool relocation = cur_node->sidle_meta.metadata.type == target_type;
+  if (relocation && !sidle::node_allocator.evacuating(target_type, cur_node)) {
     return nullptr;
   }
   // ensure the node is not being migrating, being inserted or splitted
@@ -104,7 +301,7 @@ internode_t<T>* masstree_leaf_migration(leaf_node_t<T>* cur_node, internode_t<T>
     cur_node->sidle_meta.metadata.depth, target_type,
     cur_node->sidle_meta.access_time, true);
   cur_node->lock(*cur_node, ti->lock_fence(tc_leaf_lock));
-  memcpy(new_node, cur_node, sizeof(*new_node));
+  sidle::copy_node(new_node, cur_node, sizeof(*new_node), target_type);
   new_node->sidle_meta.metadata.type = target_type;
   cur_node->mark_migration();
 
@@ -157,6 +354,16 @@ internode_t<T>* masstree_leaf_migration(leaf_node_t<T>* cur_node, internode_t<T>
     }
   }
 
+  // move the values along, a promoted leaf would otherwise still read every value from CXL.
+  // Writers of the values wait on the lock of cur_node and retry on new_node once it is deleted
+  // the values stored in the leaf have already moved with it
+  constexpr bool value_rows = std::is_pointer_v<typename T::value_type>;
+  if constexpr (value_rows) {
+    if (!relocation && masstree_value_migration_cap != 0) {
+      masstree_migrate_values(cur_node, new_node, target_type, *ti);
+    }
+  }
+
   p->assign_copy(posi_in_parent - 1, new_node);
   assert(!p || p->locked());
 
@@ -164,8 +371,19 @@ internode_t<T>* masstree_leaf_migration(leaf_node_t<T>* cur_node, internode_t<T>
   btree_leaflink<leaf_type, T::concurrent>::change_link(
     static_cast<leaf_type *>(cur_node), static_cast<leaf_type *>(new_node));
 
+  if (relocation) {
+    // the new copy was charged to the tier, the old one leaves it
+    base_node_t<T>::strategy_manager->update_local_memory_usage(target_type,
+        cur_node->sidle_meta.metadata.depth, -static_cast<int64_t>(cur_node->allocated_size()));
+  }
+
   // begin to delete the original node
   cur_node->mark_deleted();
+  if constexpr (value_rows) {
+    if (!relocation && masstree_value_migration_cap != 0) {
+      masstree_retire_values(cur_node, new_node, *ti);
+    }
+  }
   cur_node->deallocate_rcu(*ti);
   if (cur_node->locked()) {
     cur_node->unlock();
@@ -190,8 +408,9 @@ internode_t<T>* masstree_internode_migration(internode_t<T>* original_node, sidl
   }
 
   masstree_precondition(original_node->locked());
+  bool relocation = original_node->sidle_meta.type == target_type;
   if (original_node->deleted() ||
-      original_node->sidle_meta.type == target_type) {
+      (relocation && !sidle::node_allocator.evacuating(target_type, original_node))) {
     original_node->unlock();
     return nullptr;
   }
@@ -202,7 +421,7 @@ internode_t<T>* masstree_internode_migration(internode_t<T>* original_node, sidl
   internode_type *new_node = internode_type::make_with_cxl_policy(
         original_node->height_, *ti, original_node->sidle_meta.depth,
         target_type, true);
-  memcpy(new_node, original_node, sizeof(*new_node));
+  sidle::copy_node(new_node, original_node, sizeof(*new_node), target_type);
   new_node->sidle_meta.type = target_type;
   original_node->mark_migration();
   internode_type *p = original_node->locked_parent(*ti);
@@ -263,6 +482,11 @@ internode_t<T>* masstree_internode_migration(internode_t<T>* original_node, sidl
     original_node->child_[i]->set_parent(new_node);
   }
 
+  if (relocation) {
+    base_node_t<T>::strategy_manager->update_local_memory_usage(target_type,
+        original_node->sidle_meta.depth, -static_cast<int64_t>(sizeof(*original_node)));
+  }
+
   // begin to delete the original node
   original_node->mark_deleted();
   original_node->deallocate_rcu(*ti);
@@ -221,7 +221,7 @@ bool tcursor<P>::make_split(threadinfo& ti)
     // get the node position for the original node and new node
     auto new_node_type = node_type::strategy_manager->decide_new_node_position(parent_metadata.type, cur_depth);
     // allocate leaf with cxl policy
-    node_type* child = leaf_type::make_with_cxl_policy(n_->ksuf_used_capacity(), n_->phantom_epoch(), ti, cur_depth, new_node_type, 1);
+    node_type* child = leaf_type::make_with_cxl_policy(n_->ksuf_used_capacity(), n_->phantom_epoch(), ti, cur_depth, new_node_type, 1, false, n_);
     // node_type* child = leaf_type::make(n_->ksuf_used_capacity(), n_->phantom_epoch(), ti);
     child->assign_version(*n_);
     ikey_type xikey[2];
@@ -255,7 +255,7 @@ bool tcursor<P>::make_split(threadinfo& ti)
             }
             original_metadata = n->isleaf() ? static_cast<leaf_type*>(n)->sidle_meta.metadata : static_cast<internode_type*>(n)->sidle_meta;
             auto new_node_type = node_type::strategy_manager->decide_new_node_position(parent_metadata.type, cur_depth);
-            internode_type *nn = internode_type::make_with_cxl_policy(height + 1, ti, cur_depth, new_node_type);  
+            internode_type *nn = internode_type::make_with_cxl_policy(height + 1, ti, cur_depth, new_node_type, false, n);  
             // internode_type *nn = internode_type::make(height + 1, ti);
             nn->child_[0] = n;
             nn->assign(0, xikey[sense], child);
@@ -288,7 +288,7 @@ bool tcursor<P>::make_split(threadinfo& ti)
                     cur_depth = 1;
                 }  
                 auto new_node_type = node_type::strategy_manager->decide_new_node_position(parent_metadata.type, cur_depth);
-                next_child = internode_type::make_with_cxl_policy(height + 1, ti, cur_depth, new_node_type);  
+                next_child = internode_type::make_with_cxl_policy(height + 1, ti, cur_depth, new_node_type, false, p);  
                 next_child->assign_version(*p);
                 next_child->mark_nonroot();
                 kp = p->split_into(next_child, kp, xikey[sense],
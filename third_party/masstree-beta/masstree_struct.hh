@@ -165,9 +165,16 @@ class internode : public node_base<P> {
         return n;
     }
 
-    static internode<P>* make_with_cxl_policy(uint32_t height, threadinfo& ti, uint8_t depth, node_mem_type_t type, bool is_migration = false) {
+    /// @param hint a node of the same tier, usually the parent or the sibling, the new node is
+    ///        allocated in its chunk when the node slab clusters allocations
+    static internode<P>* make_with_cxl_policy(uint32_t height, threadinfo& ti, uint8_t depth, node_mem_type_t type, bool is_migration = false, const void* hint = nullptr) {
         void* ptr = nullptr;
-        if (type == node_mem_type_t::local) {
+        if (hint && sidle::node_allocator.clustered()) {
+            ptr = sidle::node_allocator.allocate_near(type, sizeof(internode<P>), hint);
+        }
+        if (ptr) {
+            // served by the node slab, freed to the thread pools like the other nodes
+        } else if (type == node_mem_type_t::local) {
             ptr = ti.pool_allocate(sizeof(internode<P>), memtag_masstree_internode);
         } else {
             ptr = ti.pool_allocate(sizeof(internode<P>), memtag_masstree_internode_remote);
@@ -368,6 +375,11 @@ class leaf : public node_base<P> {
         : node_base<P>(true), modstate_(modstate_insert),
           permutation_(permuter_type::make_empty()),
           ksuf_(), parent_(), iksuf_{}, sidle_meta(type, depth, access_time) {
+        // make and make_with_cxl_policy add up to 128 bytes of key suffixes, a large value_type
+        // (see inline_query_table_params) must leave room for them in the pools
+        static_assert((sizeof(leaf<P>) + 128 + 63) / 64 * 64 + memdebug_size
+                      <= threadinfo::pool_max_nlines * CACHE_LINE_SIZE,
+                      "a leaf with its key suffixes does not fit in threadinfo::pool_allocate");
         masstree_precondition(sz % 64 == 0 && sz / 64 < 128);
         extrasize64_ = (int(sz) >> 6) - ((int(sizeof(*this)) + 63) >> 6);
         if (extrasize64_ > 0) {
@@ -390,10 +402,16 @@ class leaf : public node_base<P> {
         return n;
     }
 
-    static leaf<P>* make_with_cxl_policy(int ksufsize, phantom_epoch_type phantom_epoch, threadinfo& ti, uint8_t depth, node_mem_type_t type, uint16_t access_time = 1, bool is_migration = false) {
+    /// @param hint see internode::make_with_cxl_policy
+    static leaf<P>* make_with_cxl_policy(int ksufsize, phantom_epoch_type phantom_epoch, threadinfo& ti, uint8_t depth, node_mem_type_t type, uint16_t access_time = 1, bool is_migration = false, const void* hint = nullptr) {
         size_t sz = iceil(sizeof(leaf<P>) + std::min(ksufsize, 128), 64);
         void* ptr = nullptr;
-        if (type == node_mem_type_t::local) {
+        if (hint && sidle::node_allocator.clustered()) {
+            ptr = sidle::node_allocator.allocate_near(type, sz, hint);
+        }
+        if (ptr) {
+            // served by the node slab, freed to the thread pools like the other nodes
+        } else if (type == node_mem_type_t::local) {
             ptr = ti.pool_allocate(sz, memtag_masstree_leaf);
         } else {
             ptr = ti.pool_allocate(sz, memtag_masstree_leaf_remote);
@@ -792,6 +810,7 @@ inline leaf<P>* node_base<P>::reach_leaf(const key_type& ka,
     while (!v[sense].isleaf()) {
         const internode<P> *in = static_cast<const internode<P>*>(n[sense]);
         in->prefetch();
+        cxl_emulate_access(in, sizeof(*in));
         int kp = internode<P>::bound_type::upper(ka, *in);
         n[sense ^ 1] = in->child_[kp];
 #ifdef CAL_NODE_HOTNESS
@@ -820,6 +839,7 @@ inline leaf<P>* node_base<P>::reach_leaf(const key_type& ka,
 
     version = v[sense];
     auto result = const_cast<leaf<P> *>(static_cast<const leaf<P> *>(n[sense]));
+    cxl_emulate_access(result, sizeof(*result));
     result->record_access();
     return result;
 }
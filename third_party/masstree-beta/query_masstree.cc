@@ -144,11 +144,7 @@ static Str findpv(N *n, int pvi, int npv)
         }
 
         if (!n->has_changed(v)) {
-            #ifdef CXL
-            char *x = (char *) malloc_with_cxl(sizeof(ikey0));
-            #else
             char *x = (char *) malloc(sizeof(ikey0));
-            #endif
             int len = string_slice<typename N::ikey_type>::unparse_comparable(x, sizeof(ikey0), ikey0);
             return Str(x, len);
         }
@@ -161,11 +157,7 @@ template <typename P>
 void query_table<P>::findpivots(Str *pv, int npv) const
 {
     pv[0].assign(NULL, 0);
-    #ifdef CXL
-    char *cmaxk = (char *)malloc_with_cxl(MASSTREE_MAXKEYLEN);
-    #else
     char *cmaxk = (char *)malloc(MASSTREE_MAXKEYLEN);
-    #endif
     memset(cmaxk, 255, MASSTREE_MAXKEYLEN);
     pv[npv - 1].assign(cmaxk, MASSTREE_MAXKEYLEN);
     for (int i = 1; i < npv - 1; i++)
@@ -78,6 +78,15 @@ struct default_query_table_params : public nodeparams<15, 15> {
     typedef ::threadinfo threadinfo_type;
 };
 
+/// @brief the parameters of a tree that stores values of N bytes in the leaves, a point read then
+///        finds the value in the leaf it reached instead of following a row pointer
+template <size_t N>
+struct inline_query_table_params : public nodeparams<15, 15> {
+    typedef value_inline<N> value_type;
+    typedef value_print<value_type> value_print_type;
+    typedef ::threadinfo threadinfo_type;
+};
+
 typedef query_table<default_query_table_params> default_table;
 
 } // namespace Masstree
@@ -0,0 +1,32 @@
+#ifndef VALUE_INLINE_HH
+#define VALUE_INLINE_HH
+#include <cstddef>
+#include <cstring>
+#include "str.hh"
+
+/// @brief a fixed-size value kept in the value slot of a leaf instead of behind a row pointer, see
+///        Masstree::inline_query_table_params. A reader copies it out with the slot under the
+///        version check of the leaf, a writer overwrites it in place with the leaf locked and
+///        marked as inserting, so the readers of the old bytes retry
+template <size_t N>
+class value_inline {
+  public:
+    typedef lcdf::Str Str;
+
+    static const char *name() { return "Inline"; }
+
+    static constexpr size_t size() {
+        return N;
+    }
+    inline Str col(int) const {
+        return Str(s_, N);
+    }
+    inline void assign(const void* value) {
+        memcpy(s_, value, N);
+    }
+
+  private:
+    char s_[N];
+};
+
+#endif
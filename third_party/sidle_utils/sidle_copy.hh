@@ -0,0 +1,61 @@
+#ifndef SIDLE_COPY_HH
+#define SIDLE_COPY_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define SIDLE_STREAMING_STORE 1
+#endif
+
+#include "sidle_meta.hh"
+
+namespace sidle {
+
+/// @brief the number of migration tasks an executor drains from the queue at once
+constexpr size_t migration_batch_size = 32;
+/// @brief the bytes prefetched per task, covering a leaf or the header and keys of an internode
+constexpr size_t migration_prefetch_bytes = 256;
+constexpr size_t migration_cache_line_size = 64;
+
+/// @brief issue prefetches for the first bytes of a node, so the reads of a whole batch overlap
+inline void prefetch_node(const void* ptr, size_t size = migration_prefetch_bytes) {
+  const char* line = reinterpret_cast<const char*>(
+      reinterpret_cast<uintptr_t>(ptr) & ~(migration_cache_line_size - 1));
+  const char* end = static_cast<const char*>(ptr) + size;
+  for (; line < end; line += migration_cache_line_size) {
+    __builtin_prefetch(line, 0, 0);
+  }
+}
+
+/// @brief copy a node to its new tier
+/// @param target_type the tier of dst. Copies toward the remote tier use non-temporal stores, so a
+///        demotion does not evict the foreground working set from the LLC. Copies toward the local
+///        tier use normal stores, since the promoted node is about to be read.
+/// @note the non-temporal stores are fenced before returning, dst may be published right after
+inline void copy_node(void* dst, const void* src, size_t size, node_mem_type target_type) {
+#ifdef SIDLE_STREAMING_STORE
+  if (target_type == node_mem_type::remote && size >= migration_cache_line_size &&
+      (reinterpret_cast<uintptr_t>(dst) & 15) == 0) {
+    __m128i* out = static_cast<__m128i*>(dst);
+    const __m128i* in = static_cast<const __m128i*>(src);
+    size_t blocks = size / sizeof(__m128i);
+    for (size_t i = 0; i < blocks; ++i) {
+      _mm_stream_si128(out + i, _mm_loadu_si128(in + i));
+    }
+    size_t copied = blocks * sizeof(__m128i);
+    if (copied < size) {
+      memcpy(static_cast<char*>(dst) + copied, static_cast<const char*>(src) + copied, size - copied);
+    }
+    _mm_sfence();
+    return;
+  }
+#endif
+  memcpy(dst, src, size);
+}
+
+}   // namespace sidle
+
+#endif /* SIDLE_COPY_HH */
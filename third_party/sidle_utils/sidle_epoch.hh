@@ -0,0 +1,158 @@
+#ifndef SIDLE_EPOCH_HH
+#define SIDLE_EPOCH_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "sidle_meta.hh"
+#include "sidle_slab.hh"
+
+namespace sidle {
+
+/// @brief the retirements of a thread between two attempts to advance the global epoch
+constexpr size_t epoch_reclaim_interval = 128;
+/// @brief the limbo lists of a tier per thread, an object retired in epoch e waits in list e % 3
+constexpr int epoch_limbo_count = 3;
+/// @brief the second word of a pinned migration task keeps the slot of its epoch in the bits from here
+constexpr int epoch_task_slot_shift = 62;
+
+/// @brief epoch-based reclamation of the index nodes unlinked from a tree. A thread announces the
+///        epoch it reads the tree in, an object retired in epoch e is given back to its tier once the
+///        global epoch reaches e + 2, since no thread can still hold a reference to it by then.
+/// @note the node pointers of queued migration tasks outlive the critical section of the thread that
+///       queued them, pin_tasks keeps them alive until the executors are done with the tasks
+class epoch_manager {
+public:
+  epoch_manager();
+  epoch_manager(const epoch_manager&) = delete;
+  epoch_manager& operator=(const epoch_manager&) = delete;
+
+  /// @brief enter a critical section, the tree can be read until the matching exit. Sections nest.
+  inline void enter() {
+    thread_record* record = local_record();
+    if (record->depth++ == 0) {
+      // a reader that stopped allocating must not hold back the release of the evacuated chunks
+      node_allocator.scrub_local();
+      uint64_t epoch = global_epoch_.load(std::memory_order_relaxed);
+      // the announcement must be visible before any node of the tree is read. With membarrier the
+      // advancing thread pays for the store-load fence, the reader only keeps the compiler in order.
+      record->state.store((epoch << 1) | 1, std::memory_order_relaxed);
+      if (membarrier_) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      } else {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+      }
+    }
+  }
+
+  inline void exit() {
+    thread_record* record = local_record();
+    if (--record->depth == 0) {
+      record->state.store(0, std::memory_order_release);
+    }
+  }
+
+  /// @brief defer giving an object unlinked from the tree back to its tier
+  /// @param size the size passed to the allocation, the object is freed with node_slab::deallocate
+  /// @note the object must already be accounted with node_slab::account_retired
+  void retire(node_mem_type type, void* ptr, size_t size);
+
+  /// @brief keep the nodes referenced by a migration task alive until unpin_tasks, call it before
+  ///        the task is queued
+  /// @param word the second word of the task, a node address or 0
+  /// @return word tagged with the slot of the epoch the task is pinned in, see task_slot
+  /// @pre the caller is in the critical section in which it read the nodes of the task
+  uint64_t pin_task(uint64_t word);
+  /// @brief release n tasks of a slot once they are executed or dropped
+  void unpin_tasks(int slot, size_t n);
+
+  /// @return the pin slot of the second word of a task returned by pin_task
+  static inline int task_slot(uint64_t word) {
+    return static_cast<int>(word >> epoch_task_slot_shift);
+  }
+
+  /// @return the second word of a task without its pin slot
+  static inline uint64_t task_word(uint64_t word) {
+    return word & ((1UL << epoch_task_slot_shift) - 1);
+  }
+
+  /// @brief advance the global epoch if every reader has caught up, and free the limbo lists of the
+  ///        calling thread and of the exited threads that became safe
+  /// @return the bytes given back to the tiers
+  size_t try_reclaim();
+
+  /// @return the global epoch
+  inline uint64_t current_epoch() const {
+    return global_epoch_.load(std::memory_order_acquire);
+  }
+
+private:
+  struct limbo_object {
+    void* ptr;
+    size_t size;
+  };
+
+  struct limbo_list {
+    uint64_t epoch{0};
+    std::vector<limbo_object> objects;
+  };
+
+  struct thread_record {
+    std::atomic<uint64_t> state{0};   // (epoch << 1) | 1 in a critical section, 0 outside
+    int depth{0};
+    size_t retired{0};                // retirements since the last try_reclaim
+    limbo_list limbo[slab_tier_count][epoch_limbo_count];
+    std::atomic<bool> in_use{false};
+    thread_record* next{nullptr};
+  };
+
+  struct thread_handle {
+    thread_record* record{nullptr};
+    ~thread_handle();
+  };
+
+  inline thread_record* local_record() {
+    thread_record* record = local_record_;
+    return record != nullptr ? record : acquire_record();
+  }
+
+  thread_record* acquire_record();
+  /// @brief hand the limbo lists of an exiting thread to the orphans, the slab cache of the thread
+  ///        may already be gone
+  void release_record(thread_record* record);
+  bool try_advance(uint64_t epoch);
+  size_t free_list(int tier, limbo_list& list);
+
+  /// @brief make the announcements of all readers visible, see enter
+  void heavy_fence();
+
+  // constant initialized, read without the TLS wrapper on the fast path
+  static inline thread_local thread_record* local_record_{nullptr};
+
+  bool membarrier_{false};
+  std::atomic<uint64_t> global_epoch_{1};
+  std::atomic<thread_record*> records_{nullptr};
+  // the tasks pinned per epoch slot count as readers of their epoch. Only the epochs e - 1 and e of
+  // the global epoch e can hold pins, so a slot is empty before the epoch it stands for comes back
+  std::atomic<size_t> pinned_tasks_[epoch_limbo_count]{};
+  std::mutex orphan_mtx_;
+  std::vector<limbo_list> orphans_[slab_tier_count];
+};
+
+extern epoch_manager node_epoch;
+
+/// @brief hold a critical section of node_epoch for a scope
+class epoch_guard {
+public:
+  epoch_guard() { node_epoch.enter(); }
+  ~epoch_guard() { node_epoch.exit(); }
+  epoch_guard(const epoch_guard&) = delete;
+  epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+}   // namespace sidle
+
+#endif /* SIDLE_EPOCH_HH */
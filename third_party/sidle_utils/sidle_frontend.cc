@@ -1,6 +1,787 @@
 #include "sidle_frontend.hh"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <linux/membarrier.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
 namespace sidle {
 
 sidle_strategy strategy_manager;
-}  // namespace sidle
\ No newline at end of file
+node_slab node_allocator;
+huge_page_arena local_arena;
+epoch_manager node_epoch;
+traverse_pool traverse_workers;
+
+static std::mutex dumper_mtx;
+static std::condition_variable dumper_cv;
+static std::thread dumper_thread;
+static bool dumper_stop = false;
+
+void huge_page_arena::init(size_t size, size_t page_size) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (start_ != nullptr || size == 0) {
+    return;
+  }
+  size = (size + page_size - 1) / page_size * page_size;
+
+  // hugetlbfs pages first, the page size is encoded as log2 in the mmap flags
+  int page_shift = __builtin_ctzl(page_size);
+  void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT), -1, 0);
+  const char* backing = "hugetlbfs";
+  if (region == MAP_FAILED) {
+    // no reserved huge pages, align the region by hand and ask for transparent huge pages
+    char* reserved = static_cast<char*>(mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+    if (reserved == MAP_FAILED) {
+      fprintf(stderr, "[huge_page_arena] fail to reserve %lu bytes, use the heap\n", size);
+      return;
+    }
+    char* aligned = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(reserved) + page_size - 1) & ~(page_size - 1));
+    if (aligned != reserved) {
+      munmap(reserved, aligned - reserved);
+    }
+    munmap(aligned + size, page_size - (aligned - reserved));
+    madvise(aligned, size, MADV_HUGEPAGE);
+    region = aligned;
+    backing = "transparent huge pages";
+  }
+  start_ = cur_ = static_cast<char*>(region);
+  end_ = start_ + size;
+  printf("[DEBUG] local arena: %lu MiB on %s, start point: %p\n", size >> 20, backing, start_);
+}
+
+void* huge_page_arena::allocate_chunk() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    void* chunk = nullptr;
+    if (free_list_ != nullptr) {
+      chunk = free_list_;
+      free_list_ = free_list_->next;
+    } else if (cur_ + slab_chunk_size <= end_) {
+      chunk = cur_;
+      cur_ += slab_chunk_size;
+    }
+    if (chunk != nullptr) {
+      used_bytes_.fetch_add(slab_chunk_size, std::memory_order_relaxed);
+      return chunk;
+    }
+  }
+
+  // the arena is exhausted, overflow to the heap
+  void* chunk = nullptr;
+  if (posix_memalign(&chunk, slab_chunk_size, slab_chunk_size) != 0) {
+    return nullptr;
+  }
+  used_bytes_.fetch_add(slab_chunk_size, std::memory_order_relaxed);
+  overflow_bytes_.fetch_add(slab_chunk_size, std::memory_order_relaxed);
+  return chunk;
+}
+
+void huge_page_arena::free_chunk(void* chunk) {
+  used_bytes_.fetch_sub(slab_chunk_size, std::memory_order_relaxed);
+  if (!contains(chunk)) {
+    overflow_bytes_.fetch_sub(slab_chunk_size, std::memory_order_relaxed);
+    free(chunk);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  free_chunk_t* node = static_cast<free_chunk_t*>(chunk);
+  node->next = free_list_;
+  free_list_ = node;
+}
+
+node_slab::thread_cache::thread_cache() {
+  // an empty cache holds no object of the chunks marked so far
+  std::lock_guard<std::mutex> lock(node_allocator.caches_mtx_);
+  scrubbed_seq.store(node_allocator.evacuation_seq_.load(), std::memory_order_relaxed);
+  next = node_allocator.caches_;
+  node_allocator.caches_ = this;
+  local_cache_ptr_ = this;
+}
+
+node_slab::thread_cache::~thread_cache() {
+  for (int tier = 0; tier < slab_tier_count; ++tier) {
+    for (int cls = 0; cls < slab_class_count; ++cls) {
+      magazine& mag = magazines[tier][cls];
+      if (mag.count > 0) {
+        node_allocator.flush(tier, cls, mag, mag.count);
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(node_allocator.caches_mtx_);
+  thread_cache** link = &node_allocator.caches_;
+  while (*link != this) {
+    link = &(*link)->next;
+  }
+  *link = next;
+  local_cache_ptr_ = nullptr;
+}
+
+void node_slab::scrub_magazines() {
+  uint64_t seq = evacuation_seq_.load(std::memory_order_acquire);
+  thread_cache* cache = local_cache_ptr_;
+  if (cache != nullptr) {
+    int tier = tier_index(node_mem_type::local);
+    for (int cls = 0; cls < slab_class_count; ++cls) {
+      magazine& mag = cache->magazines[tier][cls];
+      int kept = 0;
+      for (int i = 0; i < mag.count; ++i) {
+        if (header_of(mag.objects[i])->evacuating.load()) {
+          arenas_[tier].depots[cls].carved_count.fetch_sub(1, std::memory_order_relaxed);
+        } else {
+          mag.objects[kept++] = mag.objects[i];
+        }
+      }
+      mag.count = kept;
+    }
+    cache->scrubbed_seq.store(seq, std::memory_order_release);
+  }
+  scrubbed_seq_ = seq;
+}
+
+void node_slab::refill(int tier, int cls, magazine& mag) {
+  class_depot& depot = arenas_[tier].depots[cls];
+  {
+    // the objects of the chunks marked after they were flushed stay behind, release_evacuated drops them.
+    // A magazine scrubbed since the marking must not receive them.
+    bool filter = tracks_live(tier);
+    std::lock_guard<std::mutex> lock(depot.mtx);
+    free_object** link = &depot.head;
+    size_t taken = 0;
+    while (*link != nullptr && mag.count < slab_magazine_capacity) {
+      free_object* obj = *link;
+      if (filter && header_of(obj)->evacuating.load()) {
+        link = &obj->next;
+        continue;
+      }
+      *link = obj->next;
+      mag.objects[mag.count++] = obj;
+      ++taken;
+    }
+    depot.free_count.store(depot.free_count.load(std::memory_order_relaxed) - taken,
+                           std::memory_order_relaxed);
+  }
+  if (mag.count > 0) {
+    return;
+  }
+
+  // the depot is empty, carve a new batch and hand it out in address order
+  size_t object_size = slab_size_classes[cls];
+  char* batch = carve(tier, object_size * slab_magazine_capacity);
+  depot.carved_count.fetch_add(slab_magazine_capacity, std::memory_order_relaxed);
+  for (int i = slab_magazine_capacity - 1; i >= 0; --i) {
+    mag.objects[mag.count++] = batch + i * object_size;
+  }
+}
+
+void node_slab::flush(int tier, int cls, magazine& mag, int count) {
+  if (tracks_live(tier)) {
+    // the objects of the chunks under evacuation never reach the depot, their pages may be released.
+    // They are filtered under the lock, so a chunk marked before the splice never receives them.
+    class_depot& depot = arenas_[tier].depots[cls];
+    std::lock_guard<std::mutex> lock(depot.mtx);
+    size_t kept = 0;
+    for (int i = mag.count - count; i < mag.count; ++i) {
+      if (header_of(mag.objects[i])->evacuating.load()) {
+        depot.carved_count.fetch_sub(1, std::memory_order_relaxed);
+        continue;
+      }
+      free_object* obj = static_cast<free_object*>(mag.objects[i]);
+      obj->next = depot.head;
+      depot.head = obj;
+      ++kept;
+    }
+    mag.count -= count;
+    depot.free_count.store(depot.free_count.load(std::memory_order_relaxed) + kept,
+                           std::memory_order_relaxed);
+    return;
+  }
+
+  // link the objects outside the lock, then splice the list into the depot
+  free_object* first = static_cast<free_object*>(mag.objects[mag.count - count]);
+  free_object* last = first;
+  for (int i = mag.count - count + 1; i < mag.count; ++i) {
+    last->next = static_cast<free_object*>(mag.objects[i]);
+    last = last->next;
+  }
+  mag.count -= count;
+
+  class_depot& depot = arenas_[tier].depots[cls];
+  std::lock_guard<std::mutex> lock(depot.mtx);
+  last->next = depot.head;
+  depot.head = first;
+  depot.free_count.store(depot.free_count.load(std::memory_order_relaxed) + count,
+                         std::memory_order_relaxed);
+}
+
+char* node_slab::carve(int tier, size_t bytes) {
+  tier_arena& arena = arenas_[tier];
+  std::lock_guard<std::mutex> lock(arena.chunk_mtx);
+  char* start = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(arena.cur) + slab_cache_line_size - 1) & ~(slab_cache_line_size - 1));
+  if (arena.cur == nullptr || start + bytes > arena.end) {
+    // the tail of the old chunk is dropped, it is smaller than one batch
+    void* chunk = nullptr;
+    if (tier == tier_index(node_mem_type::remote)) {
+      posix_memalign_on_cxl(&chunk, slab_chunk_size, slab_chunk_size);
+    } else {
+      chunk = local_arena.allocate_chunk();
+    }
+    if (chunk == nullptr) {
+      throw std::runtime_error("[node_slab] fail to allocate a new chunk");
+    }
+    if (arena.cur != nullptr) {
+      arena.wasted_bytes.fetch_add(arena.end - arena.cur, std::memory_order_relaxed);
+    }
+    arena.chunk_bytes.fetch_add(slab_chunk_size, std::memory_order_relaxed);
+
+    // the header takes the first cache line, the reserve for clustered allocations the tail
+    char* chunk_start = static_cast<char*>(chunk);
+    size_t reserve = clustered() ? slab_cluster_reserve : 0;
+    chunk_header* header = new (chunk_start) chunk_header();
+    header->near_cur = chunk_start + slab_chunk_size - reserve;
+    header->near_end = chunk_start + slab_chunk_size;
+    header->next = arena.chunks;
+    arena.chunks = header;
+    uintptr_t index = reinterpret_cast<uintptr_t>(chunk_start) / slab_chunk_size;
+    if (index / 64 < chunk_map_size) {
+      chunk_map_[tier][index / 64].fetch_or(1UL << (index % 64), std::memory_order_release);
+    }
+    start = chunk_start + slab_chunk_header_size;
+    arena.end = chunk_start + slab_chunk_size - reserve;
+  }
+  arena.cur = start + bytes;
+  return start;
+}
+
+void* node_slab::allocate_near(node_mem_type type, size_t size, const void* hint) {
+  int cls = slab_size_class(size);
+  if (cls < 0) {
+    return nullptr;
+  }
+  int tier = tier_index(type);
+  chunk_header* header = hint != nullptr && clustered() ? chunk_of(tier, hint) : nullptr;
+  if (header != nullptr) {
+    size_t object_size = slab_size_classes[cls];
+    size_t align = std::min(object_size, slab_cache_line_size);
+    std::unique_lock<std::mutex> lock(header->mtx);
+    char* start = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(header->near_cur) + align - 1) & ~(align - 1));
+    if (start + object_size <= header->near_end && !header->evacuating.load()) {
+      header->near_cur = start + object_size;
+      lock.unlock();
+      arenas_[tier].depots[cls].carved_count.fetch_add(1, std::memory_order_relaxed);
+      if (!tracks_live(tier) || acquire_live(start, object_size)) {
+        return start;
+      }
+      // the chunk was marked meanwhile, the object stays in it unused
+      arenas_[tier].depots[cls].carved_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  return allocate(type, size);
+}
+
+size_t node_slab::begin_evacuation(node_mem_type type, double max_occupancy, size_t max_chunks) {
+  int tier = tier_index(type);
+  if (!tracks_live(tier)) {
+    return 0;
+  }
+  tier_arena& arena = arenas_[tier];
+  std::lock_guard<std::mutex> lock(arena.chunk_mtx);
+  const double capacity = slab_chunk_size - slab_chunk_header_size;
+  size_t marked = 0;
+  uint64_t seq = evacuation_seq_.load(std::memory_order_relaxed) + 1;
+  for (chunk_header* header = arena.chunks; header != nullptr && marked < max_chunks; header = header->next) {
+    char* chunk = reinterpret_cast<char*>(header);
+    // the chunk being carved still has objects nobody asked for yet
+    if (header->evacuating.load(std::memory_order_relaxed) || (arena.cur > chunk && arena.cur <= chunk + slab_chunk_size)) {
+      continue;
+    }
+    if (header->live_bytes.load(std::memory_order_relaxed) < capacity * max_occupancy) {
+      header->evacuation_seq = seq;
+      header->evacuating.store(true);
+      ++marked;
+    }
+  }
+  if (marked > 0) {
+    // a thread that reads the new sequence sees the marks, see scrub_local
+    evacuation_seq_.fetch_add(1);
+  }
+  return marked;
+}
+
+size_t node_slab::release_evacuated(node_mem_type type) {
+  int tier = tier_index(type);
+  if (!tracks_live(tier)) {
+    return 0;
+  }
+  tier_arena& arena = arenas_[tier];
+  std::lock_guard<std::mutex> lock(arena.chunk_mtx);
+
+  // unlink the free objects of the marked chunks from the depots, their links are about to be zeroed
+  for (int cls = 0; cls < slab_class_count; ++cls) {
+    class_depot& depot = arena.depots[cls];
+    std::lock_guard<std::mutex> depot_lock(depot.mtx);
+    free_object** link = &depot.head;
+    size_t dropped = 0;
+    while (*link != nullptr) {
+      if (header_of(*link)->evacuating.load()) {
+        *link = (*link)->next;
+        ++dropped;
+      } else {
+        link = &(*link)->next;
+      }
+    }
+    depot.free_count.store(depot.free_count.load(std::memory_order_relaxed) - dropped, std::memory_order_relaxed);
+    depot.carved_count.fetch_sub(dropped, std::memory_order_relaxed);
+  }
+
+  // the chunks marked up to the oldest sequence every thread cache has scrubbed hold no free object
+  // in a magazine any more
+  scrub_local();
+  uint64_t scrubbed = evacuation_seq_.load(std::memory_order_acquire);
+  {
+    std::lock_guard<std::mutex> caches_lock(caches_mtx_);
+    for (thread_cache* cache = caches_; cache != nullptr; cache = cache->next) {
+      scrubbed = std::min(scrubbed, cache->scrubbed_seq.load(std::memory_order_acquire));
+    }
+  }
+
+  size_t released = 0;
+  chunk_header** link = &arena.chunks;
+  while (*link != nullptr) {
+    chunk_header* header = *link;
+    int64_t expected = 0;
+    if (!header->evacuating.load() || header->evacuation_seq > scrubbed ||
+        !header->live_bytes.compare_exchange_strong(expected, chunk_releasing)) {
+      link = &header->next;
+      continue;
+    }
+    // no live object is left and no allocation can succeed, hand the whole chunk back. The hint of
+    // allocate_near is live, so no thread can reach the chunk through the map any more.
+    *link = header->next;
+    uintptr_t index = reinterpret_cast<uintptr_t>(header) / slab_chunk_size;
+    if (index / 64 < chunk_map_size) {
+      chunk_map_[tier][index / 64].fetch_and(~(1UL << (index % 64)), std::memory_order_release);
+    }
+    arena.chunk_bytes.fetch_sub(slab_chunk_size, std::memory_order_relaxed);
+    // hugetlbfs pages cannot be dropped from a 2 MiB chunk of a larger page, such chunks stay resident
+    // and are carved again from the arena
+    if (local_arena.contains(header) && madvise(header, slab_chunk_size, MADV_DONTNEED) == 0) {
+      arena.released_bytes.fetch_add(slab_chunk_size, std::memory_order_relaxed);
+    }
+    local_arena.free_chunk(header);
+    ++released;
+  }
+  return released;
+}
+
+void node_slab::get_stats(node_mem_type type, slab_tier_stats& stats) const {
+  const tier_arena& arena = arenas_[tier_index(type)];
+  stats = slab_tier_stats{};
+  stats.chunk_bytes = arena.chunk_bytes.load(std::memory_order_relaxed);
+  stats.wasted_bytes = arena.wasted_bytes.load(std::memory_order_relaxed);
+  stats.retired_bytes = std::max<int64_t>(arena.retired_bytes.load(std::memory_order_relaxed), 0);
+  stats.released_bytes = arena.released_bytes.load(std::memory_order_relaxed);
+  for (int cls = 0; cls < slab_class_count; ++cls) {
+    const class_depot& depot = arena.depots[cls];
+    size_t carved = depot.carved_count.load(std::memory_order_relaxed);
+    size_t free_objects = std::min(depot.free_count.load(std::memory_order_relaxed), carved);
+    stats.class_objects[cls] = carved - free_objects;
+    stats.used_bytes += (carved - free_objects) * slab_size_classes[cls];
+    stats.free_bytes += free_objects * slab_size_classes[cls];
+  }
+  if (stats.chunk_bytes != 0) {
+    size_t live_bytes = stats.used_bytes > stats.retired_bytes ? stats.used_bytes - stats.retired_bytes : 0;
+    stats.fragmentation = 1.0 - static_cast<double>(live_bytes) / stats.chunk_bytes;
+  }
+}
+
+epoch_manager::epoch_manager() {
+  // fall back to a full fence per critical section if the kernel lacks private expedited membarrier
+  membarrier_ = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+}
+
+void epoch_manager::heavy_fence() {
+  if (!membarrier_ || syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) != 0) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+epoch_manager::thread_handle::~thread_handle() {
+  if (record != nullptr) {
+    node_epoch.release_record(record);
+  }
+}
+
+epoch_manager::thread_record* epoch_manager::acquire_record() {
+  // the records are never freed, a thread takes over the record of an exited one
+  thread_record* record = records_.load(std::memory_order_acquire);
+  for (; record != nullptr; record = record->next) {
+    bool expected = false;
+    if (!record->in_use.load(std::memory_order_relaxed) &&
+        record->in_use.compare_exchange_strong(expected, true)) {
+      break;
+    }
+  }
+  if (record == nullptr) {
+    record = new thread_record();
+    record->in_use.store(true, std::memory_order_relaxed);
+    thread_record* head = records_.load(std::memory_order_relaxed);
+    do {
+      record->next = head;
+    } while (!records_.compare_exchange_weak(head, record, std::memory_order_release,
+                                             std::memory_order_relaxed));
+  }
+  // gives the record back when the thread exits
+  thread_local thread_handle handle;
+  handle.record = record;
+  local_record_ = record;
+  return record;
+}
+
+void epoch_manager::release_record(thread_record* record) {
+  {
+    std::lock_guard<std::mutex> lock(orphan_mtx_);
+    for (int tier = 0; tier < slab_tier_count; ++tier) {
+      for (limbo_list& list : record->limbo[tier]) {
+        if (!list.objects.empty()) {
+          orphans_[tier].push_back(std::move(list));
+          list.objects.clear();
+        }
+        list.epoch = 0;
+      }
+    }
+  }
+  record->depth = 0;
+  record->retired = 0;
+  record->state.store(0, std::memory_order_release);
+  local_record_ = nullptr;
+  record->in_use.store(false, std::memory_order_release);
+}
+
+void epoch_manager::retire(node_mem_type type, void* ptr, size_t size) {
+  thread_record* record = local_record();
+  // read after the object is unlinked, a reader still holding it announced this epoch or the previous one
+  uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+  int tier = node_slab::tier_index(type);
+  limbo_list& list = record->limbo[tier][epoch % epoch_limbo_count];
+  if (list.epoch != epoch) {
+    // the list holds the objects of epoch - 3 or earlier
+    free_list(tier, list);
+    list.epoch = epoch;
+  }
+  list.objects.push_back({ptr, size});
+  if (++record->retired >= epoch_reclaim_interval) {
+    try_reclaim();
+  }
+}
+
+uint64_t epoch_manager::pin_task(uint64_t word) {
+  // counted before the critical section ends, so an advancing thread that sees the caller leave sees the pin
+  int slot = static_cast<int>((local_record()->state.load(std::memory_order_relaxed) >> 1) % epoch_limbo_count);
+  pinned_tasks_[slot].fetch_add(1);
+  return word | (static_cast<uint64_t>(slot) << epoch_task_slot_shift);
+}
+
+void epoch_manager::unpin_tasks(int slot, size_t n) {
+  if (n != 0) {
+    pinned_tasks_[slot].fetch_sub(n, std::memory_order_release);
+  }
+}
+
+bool epoch_manager::try_advance(uint64_t epoch) {
+  heavy_fence();
+  for (thread_record* record = records_.load(std::memory_order_acquire); record != nullptr;
+       record = record->next) {
+    uint64_t state = record->state.load(std::memory_order_seq_cst);
+    if ((state & 1) && (state >> 1) != epoch) {
+      return false;
+    }
+  }
+  // the tasks pinned in epoch - 1 still hold nodes retired before the readers of epoch came in
+  if (pinned_tasks_[(epoch - 1) % epoch_limbo_count].load(std::memory_order_acquire) != 0) {
+    return false;
+  }
+  // another thread may have advanced it already
+  global_epoch_.compare_exchange_strong(epoch, epoch + 1);
+  return true;
+}
+
+size_t epoch_manager::free_list(int tier, limbo_list& list) {
+  node_mem_type type = tier == node_slab::tier_index(node_mem_type::remote) ?
+                       node_mem_type::remote : node_mem_type::local;
+  size_t bytes = 0;
+  for (limbo_object& object : list.objects) {
+    if (!node_allocator.deallocate(type, object.ptr, object.size)) {
+      free_with_cxl(object.ptr);
+    }
+    bytes += object.size;
+  }
+  if (bytes != 0) {
+    node_allocator.account_retired(type, -static_cast<int64_t>(bytes));
+  }
+  list.objects.clear();
+  return bytes;
+}
+
+size_t epoch_manager::try_reclaim() {
+  thread_record* record = local_record();
+  record->retired = 0;
+  try_advance(global_epoch_.load(std::memory_order_seq_cst));
+  uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+  size_t bytes = 0;
+  for (int tier = 0; tier < slab_tier_count; ++tier) {
+    for (limbo_list& list : record->limbo[tier]) {
+      if (!list.objects.empty() && list.epoch + 2 <= epoch) {
+        bytes += free_list(tier, list);
+      }
+    }
+  }
+  std::unique_lock<std::mutex> lock(orphan_mtx_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    for (int tier = 0; tier < slab_tier_count; ++tier) {
+      std::vector<limbo_list>& orphans = orphans_[tier];
+      for (size_t i = 0; i < orphans.size();) {
+        if (orphans[i].epoch + 2 <= epoch) {
+          bytes += free_list(tier, orphans[i]);
+          orphans[i] = std::move(orphans.back());
+          orphans.pop_back();
+        } else {
+          ++i;
+        }
+      }
+    }
+  }
+  return bytes;
+}
+
+void add_local_slab_stats(cxl_tier_stats* stats) {
+  slab_tier_stats slab;
+  node_allocator.get_stats(node_mem_type::local, slab);
+  size_t overflow = local_arena.overflow_bytes();
+  stats->allocated_bytes = stats->allocated_bytes - std::min(overflow, stats->allocated_bytes) + slab.used_bytes;
+  stats->active_bytes = stats->active_bytes - std::min(overflow, stats->active_bytes) + slab.chunk_bytes;
+}
+
+void dump_memory_stats(FILE* out) {
+  fprintf(out, "[memory stats] local budget: %ld / %lu KiB, local arena: %lu / %lu KiB, overflow %lu KiB\n",
+          strategy_manager.get_cur_local_memory_usage() >> 10, strategy_manager.get_max_local_memory_usage() >> 10,
+          local_arena.used_bytes() >> 10, local_arena.capacity() >> 10, local_arena.overflow_bytes() >> 10);
+  for (node_mem_type type : {node_mem_type::local, node_mem_type::remote}) {
+    slab_tier_stats stats;
+    node_allocator.get_stats(type, stats);
+    fprintf(out, "[memory stats] %s slab: chunks %lu KiB, used %lu KiB, free %lu KiB, wasted %lu KiB, "
+            "retired %lu KiB, released %lu KiB, fragmentation %.3f\n",
+            type == node_mem_type::local ? "local" : "remote", stats.chunk_bytes >> 10,
+            stats.used_bytes >> 10, stats.free_bytes >> 10, stats.wasted_bytes >> 10,
+            stats.retired_bytes >> 10, stats.released_bytes >> 10, stats.fragmentation);
+    fprintf(out, "[memory stats] %s slab objects per size class:",
+            type == node_mem_type::local ? "local" : "remote");
+    for (int cls = 0; cls < slab_class_count; ++cls) {
+      if (stats.class_objects[cls] != 0) {
+        fprintf(out, " %luB:%lu", slab_size_classes[cls], stats.class_objects[cls]);
+      }
+    }
+    fprintf(out, "\n");
+  }
+  tier_ratio ratio = remote_tier_ratio();
+  if (ratio.measured) {
+    fprintf(out, "[memory stats] remote / local: latency x%.2f, bandwidth /%.2f\n", ratio.latency, ratio.bandwidth);
+  }
+  cxl_dump_stats(out);
+  fflush(out);
+}
+
+void traverse_pool::start(size_t workers, const std::vector<int>& cpus) {
+  std::lock_guard<std::mutex> lock(run_mtx_);
+  if (!threads_.empty() || workers <= 1) {
+    return;
+  }
+  deques_.reset(new task_deque[workers]);
+  worker_count_ = workers;
+  stopping_ = false;
+  for (size_t i = 1; i < workers; ++i) {
+    int cpu = cpus.empty() ? -1 : cpus[(i - 1) % cpus.size()];
+    threads_.emplace_back(&traverse_pool::worker_loop, this, static_cast<int>(i), cpu);
+  }
+}
+
+void traverse_pool::stop() {
+  std::lock_guard<std::mutex> lock(run_mtx_);
+  {
+    std::lock_guard<std::mutex> wakeup_lock(wakeup_mtx_);
+    stopping_ = true;
+  }
+  wakeup_cv_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  deques_.reset(new task_deque[1]);
+  worker_count_ = 1;
+}
+
+void traverse_pool::run(const traverse_task* tasks, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(run_mtx_);
+  // deal the tasks out so that every worker starts from its own deque
+  pending_.fetch_add(n, std::memory_order_relaxed);
+  for (size_t i = 0; i < n; ++i) {
+    task_deque& deque = deques_[i % worker_count_];
+    std::lock_guard<std::mutex> deque_lock(deque.mtx);
+    deque.tasks.push_back(tasks[i]);
+    deque.size.store(deque.tasks.size() - deque.head, std::memory_order_relaxed);
+  }
+  if (!threads_.empty()) {
+    {
+      std::lock_guard<std::mutex> wakeup_lock(wakeup_mtx_);
+      ++generation_;
+    }
+    wakeup_cv_.notify_all();
+  }
+  work(0);
+}
+
+void traverse_pool::spawn(int worker, const traverse_task& task) {
+  // counted before it can be taken, the run is not done while a parent task is running
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  task_deque& deque = deques_[worker];
+  std::lock_guard<std::mutex> lock(deque.mtx);
+  deque.tasks.push_back(task);
+  deque.size.store(deque.tasks.size() - deque.head, std::memory_order_relaxed);
+}
+
+bool traverse_pool::pop(int worker, traverse_task& task) {
+  task_deque& deque = deques_[worker];
+  if (deque.size.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(deque.mtx);
+  if (deque.tasks.size() == deque.head) {
+    return false;
+  }
+  task = deque.tasks.back();
+  deque.tasks.pop_back();
+  if (deque.tasks.size() == deque.head) {
+    deque.tasks.clear();
+    deque.head = 0;
+  }
+  deque.size.store(deque.tasks.size() - deque.head, std::memory_order_relaxed);
+  return true;
+}
+
+bool traverse_pool::steal(int worker, traverse_task& task) {
+  // the oldest task of a victim is the largest subtree it has split off
+  for (size_t i = 1; i < worker_count_; ++i) {
+    task_deque& deque = deques_[(worker + i) % worker_count_];
+    if (deque.size.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(deque.mtx);
+    if (deque.tasks.size() == deque.head) {
+      continue;
+    }
+    task = deque.tasks[deque.head++];
+    if (deque.tasks.size() == deque.head) {
+      deque.tasks.clear();
+      deque.head = 0;
+    }
+    deque.size.store(deque.tasks.size() - deque.head, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+void traverse_pool::work(int worker) {
+  worker_id_ = worker;
+  bool idle = false;
+  traverse_task task;
+  while (pending_.load(std::memory_order_acquire) != 0) {
+    if (pop(worker, task) || steal(worker, task)) {
+      if (idle) {
+        idle_.fetch_sub(1, std::memory_order_relaxed);
+        idle = false;
+      }
+      task.run(*this, task, worker);
+      pending_.fetch_sub(1, std::memory_order_release);
+      continue;
+    }
+    if (!idle) {
+      idle_.fetch_add(1, std::memory_order_relaxed);
+      idle = true;
+    }
+    std::this_thread::yield();
+  }
+  if (idle) {
+    idle_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  worker_id_ = 0;
+}
+
+void traverse_pool::worker_loop(int worker, int cpu) {
+  if (cpu >= 0) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    sched_setaffinity(0, sizeof(mask), &mask);
+  }
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(wakeup_mtx_);
+      wakeup_cv_.wait(lock, [this, seen] { return stopping_ || generation_ != seen; });
+      if (stopping_) {
+        return;
+      }
+      seen = generation_;
+    }
+    epoch_guard guard;
+    work(worker);
+  }
+}
+
+void start_stats_dumper(uint64_t interval_ms) {
+  std::lock_guard<std::mutex> lock(dumper_mtx);
+  if (dumper_thread.joinable() || interval_ms == 0) {
+    return;
+  }
+  dumper_stop = false;
+  dumper_thread = std::thread([interval_ms]() {
+    std::unique_lock<std::mutex> lock(dumper_mtx);
+    while (!dumper_cv.wait_for(lock, std::chrono::milliseconds(interval_ms), [] { return dumper_stop; })) {
+      dump_memory_stats(stdout);
+    }
+  });
+}
+
+void stop_stats_dumper() {
+  {
+    std::lock_guard<std::mutex> lock(dumper_mtx);
+    dumper_stop = true;
+  }
+  dumper_cv.notify_all();
+  if (dumper_thread.joinable()) {
+    dumper_thread.join();
+  }
+}
+
+}  // namespace sidle
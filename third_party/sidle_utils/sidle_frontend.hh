@@ -2,23 +2,158 @@
 #define SIDLE_FRONTEND_HH
 
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <type_traits>
+#include <vector>
 #include <sys/types.h>
 #include "cxl_allocator.h"
+#include "sidle_epoch.hh"
 #include "sidle_policy.hh"
+#include "sidle_slab.hh"
+#include "sidle_traverse.hh"
 
 namespace sidle {
 
 extern sidle_strategy strategy_manager;
 
+/// @brief add the local chunks of the node slab to the malloc usage of the local tier, the hook of
+///        cxl_get_tier_stats. The chunks that overflowed the arena are counted once, as slab chunks.
+void add_local_slab_stats(cxl_tier_stats* stats);
+
+/// @brief reserve the huge-page local arena for the local budget of strategy_manager
+/// @note set SIDLE_LOCAL_1G_PAGES=1 to back the arena with 1 GiB pages instead of 2 MiB pages, and
+///       SIDLE_CLUSTERED_ALLOC=1 to allocate the nodes in the chunk of their parent, and
+///       SIDLE_COMPACTION=1 to track the local chunks for the compactor
+inline void init_local_arena() {
+  const char* env = getenv("SIDLE_LOCAL_1G_PAGES");
+  size_t page_size = env != nullptr && atoi(env) != 0 ? (1UL << 30) : slab_chunk_size;
+  local_arena.init(strategy_manager.get_max_local_memory_usage(), page_size);
+  cxl_set_local_stats_hook(add_local_slab_stats);
+  env = getenv("SIDLE_CLUSTERED_ALLOC");
+  if (env != nullptr && atoi(env) != 0) {
+    node_allocator.set_clustered(true);
+  }
+  env = getenv("SIDLE_COMPACTION");
+  if (env != nullptr && atoi(env) != 0) {
+    node_allocator.set_compaction(true);
+  }
+}
+
+/// @brief start the workers of the parallel traversals of the migration trigger and the cooler
+/// @note set SIDLE_TRAVERSE_WORKERS to the workers of a traversal, the calling thread included, and
+///       SIDLE_TRAVERSE_CPUS to a cpu list like 0-3,8 to pin the started threads to those cpus
+inline void init_traverse_workers() {
+  const char* env = getenv("SIDLE_TRAVERSE_WORKERS");
+  size_t workers = env != nullptr ? strtoul(env, nullptr, 10) : default_traverse_workers;
+  std::vector<int> cpus;
+  env = getenv("SIDLE_TRAVERSE_CPUS");
+  while (env != nullptr && *env != '\0') {
+    char* end;
+    int first = strtol(env, &end, 10);
+    int last = *end == '-' ? strtol(end + 1, &end, 10) : first;
+    if (end == env) {
+      break;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    env = *end == ',' ? end + 1 : end;
+  }
+  traverse_workers.start(workers, cpus);
+}
+
+/// @brief check the requested-size accounting of strategy_manager against the local chunks in use
+/// @return false if the strategy accounts for more local memory than the local arena holds
+inline bool check_local_memory_accounting() {
+  return strategy_manager.get_cur_local_memory_usage() <=
+         static_cast<int64_t>(local_arena.used_bytes());
+}
+
+/// @brief how much slower the CXL tier is than local memory, from the calibration of cxl_init
+struct tier_ratio {
+  bool measured{false};   // false if calibration is disabled, the ratios are then 1
+  double latency{1};      // remote latency / local latency
+  double bandwidth{1};    // local read bandwidth / remote read bandwidth
+};
+
+/// @brief get the ratio of a CXL tier against local memory
+/// @param tier the tier of a CXL region, the first region by default
+inline tier_ratio remote_tier_ratio(int tier = CXL_LOCAL_TIER + 1) {
+  tier_profile local, remote;
+  tier_ratio ratio;
+  if (cxl_get_tier_profile(CXL_LOCAL_TIER, &local) != 0 || cxl_get_tier_profile(tier, &remote) != 0 ||
+      !local.valid || !remote.valid) {
+    return ratio;
+  }
+  ratio.measured = true;
+  ratio.latency = remote.latency_ns / local.latency_ns;
+  ratio.bandwidth = local.read_bandwidth_mbps / remote.read_bandwidth_mbps;
+  return ratio;
+}
+
+/// @brief print the local budget, the local arena, the node slab of each tier and the per-tier
+///        statistics of the cxl allocator
+void dump_memory_stats(FILE* out);
+
+/// @brief dump the memory statistics to stdout every interval_ms in a background thread
+/// @note a no-op if the dumper is already running or interval_ms is 0
+void start_stats_dumper(uint64_t interval_ms);
+
+/// @brief stop the dumper started by start_stats_dumper
+void stop_stats_dumper();
+
+/// @brief the tier of a node, the type tells local or remote and the index tells which CXL region
+struct node_tier {
+  node_mem_type type;
+  uint8_t index;
+};
+
+/// @brief classify a node address in O(1) with the tier map of the cxl allocator
+inline node_tier tier_of(const void* ptr) {
+  int tier = cxl_tier_of(ptr);
+  if (tier == CXL_LOCAL_TIER) {
+    return node_tier{node_mem_type::local, 0};
+  }
+  return node_tier{node_mem_type::remote, static_cast<uint8_t>(tier - 1)};
+}
+
+/// @brief place a node in target_type without charging the local budget, a bulk load charges
+///        the local bytes of all its nodes at once
+/// @tparam T is the type of target node, P is the type of parent node
+/// @param depth the depth of the node, 0 to derive it from parent
+template <typename T, typename P>
+T* sidle_place(size_t size, P* parent, sidle::node_mem_type new_node_type, uint8_t depth = 0) {
+  uint8_t cur_depth = depth != 0 ? depth : parent == nullptr ? 1 : parent->sidle_meta.depth + 1;
+  T* an = static_cast<T*>(parent != nullptr && node_allocator.clustered() ?
+                          node_allocator.allocate_near(new_node_type, size, parent) :
+                          node_allocator.allocate(new_node_type, size));
+  if (unlikely(an == nullptr)) {
+    // larger than every slab class
+    if (new_node_type == sidle::node_mem_type::remote) {
+      malloc_on_cxl(size, reinterpret_cast<void**>(&an));
+    } else {
+      an = static_cast<T*>(malloc(size));
+    }
+  }
+  if constexpr (std::is_same_v<decltype(an->sidle_meta), sidle::node_metadata>) {
+    an->sidle_meta = sidle::node_metadata(new_node_type, cur_depth);
+  } else {
+    an->sidle_meta = sidle::leaf_metadata(new_node_type, cur_depth, 0);
+  }
+  return an;
+}
+
 /// @brief allocate node according to single_boundary allocation or migration
 /// @tparam T is the type of target node, P is the type of parent node
 /// @param old_size a sepecial field for node expansion
+/// @param depth the depth of the node, 0 to derive it from parent
 /// @return 
 template <typename T, typename P>
 T* sidle_alloc(size_t size, P* parent, sidle::node_mem_type target_type, 
-                      bool is_migration, bool is_leaf, size_t old_size = 0) {
-  uint8_t cur_depth = parent == nullptr ? 1 : parent->sidle_meta.depth + 1;
+                      bool is_migration, bool is_leaf, size_t old_size = 0, uint8_t depth = 0) {
+  uint8_t cur_depth = depth != 0 ? depth : parent == nullptr ? 1 : parent->sidle_meta.depth + 1;
   auto new_node_type = target_type;
   if (new_node_type == sidle::node_mem_type::unknown) {
     sidle::node_mem_type parent_type = parent == nullptr ? 
@@ -26,17 +161,7 @@ T* sidle_alloc(size_t size, P* parent, sidle::node_mem_type target_type,
     new_node_type = strategy_manager.decide_new_node_position(
                           parent_type, cur_depth);
   }
-  T* an = nullptr;
-  if (new_node_type == sidle::node_mem_type::remote) {
-    malloc_on_cxl(size, reinterpret_cast<void**>(&an));
-  } else {
-    an = static_cast<T*>(malloc(size));
-  }
-  if constexpr (std::is_same_v<decltype(an->sidle_meta), sidle::node_metadata>) {
-    an->sidle_meta = sidle::node_metadata(new_node_type, cur_depth);
-  } else {
-    an->sidle_meta = sidle::leaf_metadata(new_node_type, cur_depth, 0);
-  }
+  T* an = sidle_place<T, P>(size, parent, new_node_type, cur_depth);
 
   if (new_node_type == sidle::node_mem_type::local || is_migration) {
     strategy_manager.update_local_memory_usage(new_node_type, 
@@ -48,11 +173,14 @@ T* sidle_alloc(size_t size, P* parent, sidle::node_mem_type target_type,
 
 /// @brief free the node allocated by sidle_alloc
 /// @tparam T is the type of the node
-/// @param size is the size of the node
+/// @param size is the size of the node, which must match the size passed to sidle_alloc
 template <typename T>
 void sidle_free(T* an, size_t size) {
-  strategy_manager.update_local_memory_usage(an->sidle_meta.type, an->sidle_meta.depth, size, false, false);
-  free_with_cxl((void*)an);
+  strategy_manager.update_local_memory_usage(an->sidle_meta.get_type(), an->sidle_meta.depth,
+                                             -static_cast<int64_t>(size), false, false);
+  if (!node_allocator.deallocate(an->sidle_meta.get_type(), an, size)) {
+    free_with_cxl((void*)an);
+  }
 }
 
 /// @brief update the access count of the leaf node
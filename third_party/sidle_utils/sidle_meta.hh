@@ -29,7 +29,7 @@
 
 namespace sidle {
 enum class worker_type {
-    migration_trigger, promotion_executor, demotion_executor, cooler, threshold_adjuster
+    migration_trigger, promotion_executor, demotion_executor, cooler, threshold_adjuster, compactor
 };
 
 enum class node_mem_type : uint8_t {
@@ -127,6 +127,34 @@ public:
         return result;
     }
 
+    /// @brief drain up to max tasks of the single-node queue
+    /// @return the number of tasks written to out
+    std::size_t get_tasks(task_type type, uint64_t *out, std::size_t max) {
+        std::size_t count = 0;
+        if (type == task_type::promotion) {
+            count = promotion_queue_->try_dequeue_bulk(out, max);
+            promotion_queue_length_.fetch_add(-static_cast<int32_t>(count), std::memory_order_relaxed);
+        } else {
+            count = demotion_queue_->try_dequeue_bulk(out, max);
+            demotion_queue_length_.fetch_add(-static_cast<int32_t>(count), std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    /// @brief drain up to max tasks of the pair queue
+    /// @return the number of tasks written to out
+    std::size_t get_multi_tasks(task_type type, node_pair *out, std::size_t max) {
+        std::size_t count = 0;
+        if (type == task_type::promotion) {
+            count = promotion_pair_queue_->try_dequeue_bulk(out, max);
+            promotion_queue_length_.fetch_add(-static_cast<int32_t>(count), std::memory_order_relaxed);
+        } else {
+            count = demotion_pair_queue_->try_dequeue_bulk(out, max);
+            demotion_queue_length_.fetch_add(-static_cast<int32_t>(count), std::memory_order_relaxed);
+        }
+        return count;
+    }
+
     void add_task(task_type type, uint64_t data) {
         if (type == task_type::promotion) {
             promotion_queue_->enqueue(data);
@@ -39,6 +39,11 @@ constexpr uint16_t default_hot_threshold = 128;
 constexpr uint16_t default_cold_threshold = 4;
 constexpr size_t queue_waiting_threshold = 10;
 constexpr int default_threshold_adjust_times = 3;
+// the local slab is compacted once the free objects take this share of its chunks
+constexpr double default_compaction_fragmentation = 0.3;
+// the chunks under this share of live bytes are evacuated
+constexpr double default_compaction_max_occupancy = 0.5;
+constexpr size_t default_compaction_max_chunks = 64;
 
 /// @note this class should be singleton
 class sidle_threshold {
@@ -284,6 +289,10 @@ public:
     }
   }
 
+  inline uint64_t get_max_local_memory_usage() const { return max_local_memory_usage_; }
+
+  inline int64_t get_cur_local_memory_usage() const { return cur_local_memory_usage_; }
+
   inline mem_usage_status check_memory_usage() {
     double memory_usage_ratio = static_cast<double>(cur_local_memory_usage_) / 
                                 max_local_memory_usage_;
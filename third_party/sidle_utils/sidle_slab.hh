@@ -0,0 +1,365 @@
+#ifndef SIDLE_SLAB_HH
+#define SIDLE_SLAB_HH
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "sidle_meta.hh"
+
+namespace sidle {
+
+/// @brief the object sizes served by the node slab. The classes below a cache line are powers of
+///        two so that small ART leaves never straddle a cache line, the others are cache line
+///        multiples covering art_node4 (128), art_node16 (192), art_node48 (704) and art_node256 (2112)
+constexpr size_t slab_size_classes[] = {16, 32, 64, 128, 192, 256, 384, 512, 704, 1024, 1536, 2112};
+constexpr int slab_class_count = sizeof(slab_size_classes) / sizeof(slab_size_classes[0]);
+constexpr size_t slab_max_object_size = slab_size_classes[slab_class_count - 1];
+constexpr size_t slab_chunk_size = 2 * 1024 * 1024;
+constexpr size_t slab_cache_line_size = 64;
+constexpr int slab_magazine_capacity = 32;
+constexpr int slab_tier_count = 2;
+/// @brief the tail of every chunk kept for clustered allocations when clustering is enabled
+constexpr size_t slab_cluster_reserve = slab_chunk_size / 4;
+/// @brief the head of every chunk holding its chunk_header
+constexpr size_t slab_chunk_header_size = 2 * slab_cache_line_size;
+
+/// @brief map the requested size to its size class
+/// @return the index of the smallest class fitting size, -1 if size is larger than every class
+inline int slab_size_class(size_t size) {
+  static constexpr auto class_table = [] {
+    std::array<int8_t, slab_max_object_size / 16 + 1> table{};
+    int cls = 0;
+    for (size_t i = 0; i < table.size(); ++i) {
+      while (slab_size_classes[cls] < i * 16) {
+        ++cls;
+      }
+      table[i] = static_cast<int8_t>(cls);
+    }
+    return table;
+  }();
+  return size > slab_max_object_size ? -1 : class_table[(size + 15) / 16];
+}
+
+/// @brief a huge-page backed region that hands out slab_chunk_size chunks to the local tier, so the
+///        local budget is physically contiguous and covered by few dTLB entries. Freed chunks go to a
+///        free list, and requests beyond the arena overflow to the heap.
+class huge_page_arena {
+public:
+  /// @brief reserve the arena, a no-op if it is already initialized
+  /// @param size the local memory budget, rounded up to page_size
+  /// @param page_size 2 MiB or 1 GiB, falls back to transparent huge pages if hugetlbfs pages are not reserved
+  void init(size_t size, size_t page_size = slab_chunk_size);
+
+  /// @brief get a chunk of slab_chunk_size bytes aligned to slab_chunk_size
+  /// @return the chunk, nullptr if the heap is also exhausted
+  void* allocate_chunk();
+
+  /// @brief return a chunk from allocate_chunk
+  void free_chunk(void* chunk);
+
+  inline bool contains(const void* ptr) const {
+    return ptr >= start_ && ptr < end_;
+  }
+
+  /// @brief the bytes of the chunks in use, both in the arena and overflowed to the heap
+  inline size_t used_bytes() const {
+    return used_bytes_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief the bytes of the chunks in use that overflowed to the heap
+  inline size_t overflow_bytes() const {
+    return overflow_bytes_.load(std::memory_order_relaxed);
+  }
+
+  inline size_t capacity() const {
+    return end_ - start_;
+  }
+
+private:
+  struct free_chunk_t {
+    free_chunk_t* next;
+  };
+
+  std::mutex mtx_;
+  char* start_{nullptr};
+  char* cur_{nullptr};
+  char* end_{nullptr};
+  free_chunk_t* free_list_{nullptr};
+  std::atomic<size_t> used_bytes_{0};
+  std::atomic<size_t> overflow_bytes_{0};
+};
+
+extern huge_page_arena local_arena;
+
+/// @brief the memory of one tier of the node slab
+struct slab_tier_stats {
+  size_t chunk_bytes{0};      // bytes of the chunks the tier carved objects from
+  size_t wasted_bytes{0};     // chunk tails dropped because a batch did not fit
+  size_t used_bytes{0};       // bytes of the objects handed out, including the objects cached in thread magazines
+  size_t free_bytes{0};       // bytes of the objects back in the depots
+  size_t retired_bytes{0};    // bytes of the nodes unlinked from the tree and not reclaimed yet, see epoch_manager
+  size_t released_bytes{0};   // bytes of the chunks emptied by the compactor and given back to the OS
+  size_t class_objects[slab_class_count]{};   // objects handed out per size class
+  double fragmentation{0};    // the share of the chunk bytes not holding a live node
+};
+
+/// @brief a size-class slab allocator for index nodes, with one arena per memory tier.
+///        Each thread keeps a magazine of free objects per (tier, class), so the common alloc/free is a
+///        lock-free array push/pop. Magazines are refilled from and flushed to a per-class depot in
+///        batches, and the depots carve new objects from 2 MiB chunks of their tier.
+/// @note the chunks are never returned to the tier, like the node pools of Masstree, except for the
+///       local chunks drained by the compactor. The local chunks come from local_arena.
+class node_slab {
+public:
+  /// @brief allocate an object on the tier
+  /// @return the object, nullptr if size is larger than the largest class
+  inline void* allocate(node_mem_type type, size_t size);
+
+  /// @brief the index of a tier in the per-tier state, 0 for the local tier and 1 for the remote one
+  static inline int tier_index(node_mem_type type) {
+    return type == node_mem_type::remote ? 1 : 0;
+  }
+
+  /// @brief return an object to the tier it was allocated from
+  /// @param size must be the size passed to allocate
+  /// @return false if the object is not served by the slab
+  inline bool deallocate(node_mem_type type, void* ptr, size_t size);
+
+  /// @brief allocate an object in the same chunk as hint, so a subtree shares few pages
+  /// @param hint a node of the same tier, usually the parent. It must stay allocated during the call,
+  ///        so its chunk cannot be released under it
+  /// @return the object, from another chunk if clustering is disabled, hint is not a slab object of
+  ///         the tier or its chunk is full, nullptr if size is larger than the largest class
+  void* allocate_near(node_mem_type type, size_t size, const void* hint);
+
+  /// @brief reserve the tail of the chunks carved from now on for allocate_near
+  void set_clustered(bool clustered) {
+    clustered_.store(clustered, std::memory_order_relaxed);
+  }
+
+  bool clustered() const {
+    return clustered_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief track the live bytes of every local chunk, so the compactor can find the sparse ones
+  /// @note must be enabled before the first local allocation
+  void set_compaction(bool compaction) {
+    compaction_.store(compaction, std::memory_order_relaxed);
+  }
+
+  bool compaction() const {
+    return compaction_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief mark the sparse chunks of the tier for evacuation. The free objects of a marked chunk are
+  ///        never handed out again, so it drains as the compactor relocates its live nodes.
+  /// @param max_occupancy the share of live bytes under which a chunk is evacuated
+  /// @return the number of chunks marked, 0 if compaction is disabled or the tier is not tracked
+  size_t begin_evacuation(node_mem_type type, double max_occupancy, size_t max_chunks);
+
+  /// @brief whether ptr is a slab object of the tier in a chunk under evacuation
+  inline bool evacuating(node_mem_type type, const void* ptr) const {
+    int tier = tier_index(type);
+    chunk_header* header = tracks_live(tier) ? chunk_of(tier, ptr) : nullptr;
+    return header != nullptr && header->evacuating.load(std::memory_order_acquire);
+  }
+
+  /// @brief give the evacuated chunks without live objects back to local_arena, and their pages to the
+  ///        OS when they can be dropped. A chunk is only given back once every thread cache has scrubbed
+  ///        the free objects of the chunk from its magazines, see scrub_local
+  /// @return the number of chunks given back
+  size_t release_evacuated(node_mem_type type);
+
+  /// @brief drop the free objects of the chunks marked since the last call from the magazines of the
+  ///        calling thread. Called on every local allocate and deallocate, and by the readers of the
+  ///        trees when they enter node_epoch, so the threads that stopped allocating do not hold back
+  ///        the release of the evacuated chunks
+  inline void scrub_local() {
+    if (scrubbed_seq_ != evacuation_seq_.load(std::memory_order_acquire)) {
+      scrub_magazines();
+    }
+  }
+
+  /// @brief account a node that is unlinked from the tree but not freed, or reclaimed later
+  /// @param bytes the node size, negative when the node is reclaimed
+  inline void account_retired(node_mem_type type, int64_t bytes) {
+    arenas_[tier_index(type)].retired_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  /// @brief collect the statistics of a tier, the counters are read without stopping the allocating threads
+  void get_stats(node_mem_type type, slab_tier_stats& stats) const;
+
+private:
+  struct free_object {
+    free_object* next;
+  };
+
+  struct magazine {
+    int count{0};
+    void* objects[slab_magazine_capacity];
+  };
+
+  struct thread_cache {
+    magazine magazines[slab_tier_count][slab_class_count];
+    std::atomic<uint64_t> scrubbed_seq{0};   // the last evacuation_seq_ scrubbed, read by release_evacuated
+    thread_cache* next{nullptr};            // the next registered cache, written under caches_mtx_
+    thread_cache();
+    ~thread_cache();
+  };
+
+  struct class_depot {
+    std::mutex mtx;
+    free_object* head{nullptr};
+    std::atomic<size_t> free_count{0};      // objects in the list, written under mtx
+    std::atomic<size_t> carved_count{0};    // objects ever carved for this class
+  };
+
+  /// @brief the head of every chunk, the clustered allocations bump down from the end
+  struct chunk_header {
+    std::mutex mtx;
+    char* near_cur{nullptr};
+    char* near_end{nullptr};
+    chunk_header* next{nullptr};              // the next chunk of the tier, written under chunk_mtx
+    std::atomic<int64_t> live_bytes{0};       // bytes handed out and not freed, tracked with compaction
+    std::atomic<bool> evacuating{false};
+    uint64_t evacuation_seq{0};               // the evacuation_seq_ the chunk was marked in, under chunk_mtx
+  };
+  static_assert(sizeof(chunk_header) <= slab_chunk_header_size, "the chunk header overlaps the objects");
+
+  /// @brief the live bytes of a chunk while it is given back, no allocation can succeed
+  static constexpr int64_t chunk_releasing = INT64_MIN / 2;
+
+  struct tier_arena {
+    std::mutex chunk_mtx;
+    char* cur{nullptr};
+    char* end{nullptr};
+    std::atomic<size_t> chunk_bytes{0};
+    std::atomic<size_t> wasted_bytes{0};
+    std::atomic<int64_t> retired_bytes{0};
+    std::atomic<size_t> released_bytes{0};
+    chunk_header* chunks{nullptr};
+    class_depot depots[slab_class_count];
+  };
+
+  static inline thread_cache& local_cache() {
+    thread_local thread_cache cache;
+    return cache;
+  }
+
+  /// @brief the slow path of scrub_local
+  void scrub_magazines();
+
+  static inline chunk_header* header_of(const void* ptr) {
+    return reinterpret_cast<chunk_header*>(reinterpret_cast<uintptr_t>(ptr) & ~(slab_chunk_size - 1));
+  }
+
+  /// @brief only the local chunks are compacted
+  inline bool tracks_live(int tier) const {
+    return tier == tier_index(node_mem_type::local) && compaction_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief count an object handed out in the live bytes of its chunk
+  /// @return false if the chunk is under evacuation, the object must not be used
+  static inline bool acquire_live(void* obj, size_t bytes) {
+    chunk_header* header = header_of(obj);
+    if (header->live_bytes.fetch_add(bytes) >= 0 && !header->evacuating.load()) {
+      return true;
+    }
+    header->live_bytes.fetch_sub(bytes);
+    return false;
+  }
+
+  /// @brief fill an empty magazine from the depot, or from a fresh batch of the chunk
+  void refill(int tier, int cls, magazine& mag);
+
+  /// @brief move the top count objects of the magazine back to the depot
+  void flush(int tier, int cls, magazine& mag, int count);
+
+  /// @brief carve a cache line aligned batch from the current chunk of the tier
+  char* carve(int tier, size_t bytes);
+
+  /// @brief the chunk of a slab object, nullptr if ptr is not in a chunk of the tier
+  chunk_header* chunk_of(int tier, const void* ptr) const {
+    uintptr_t index = reinterpret_cast<uintptr_t>(ptr) / slab_chunk_size;
+    if (index / 64 >= chunk_map_size) {
+      return nullptr;
+    }
+    uint64_t word = chunk_map_[tier][index / 64].load(std::memory_order_acquire);
+    if ((word & (1UL << (index % 64))) == 0) {
+      return nullptr;
+    }
+    return reinterpret_cast<chunk_header*>(index * slab_chunk_size);
+  }
+
+  /// @brief one bit per 2 MiB of the 47-bit address space and tier, so a hint is classified without
+  ///        touching memory. The untouched pages of the bitmap are never backed.
+  static constexpr size_t chunk_map_size = (1UL << 47) / slab_chunk_size / 64;
+
+  // constant initialized, read without the TLS wrapper on the fast path of scrub_local
+  static inline thread_local uint64_t scrubbed_seq_{0};
+  static inline thread_local thread_cache* local_cache_ptr_{nullptr};
+
+  tier_arena arenas_[slab_tier_count];
+  // bumped by every begin_evacuation that marks a chunk
+  std::atomic<uint64_t> evacuation_seq_{0};
+  std::mutex caches_mtx_;
+  thread_cache* caches_{nullptr};
+  std::atomic<bool> clustered_{false};
+  std::atomic<bool> compaction_{false};
+  std::atomic<uint64_t> chunk_map_[slab_tier_count][chunk_map_size]{};
+};
+
+extern node_slab node_allocator;
+
+inline void* node_slab::allocate(node_mem_type type, size_t size) {
+  int cls = slab_size_class(size);
+  if (cls < 0) {
+    return nullptr;
+  }
+  int tier = tier_index(type);
+  if (tracks_live(tier)) {
+    scrub_local();
+  }
+  magazine& mag = local_cache().magazines[tier][cls];
+  while (true) {
+    if (mag.count == 0) {
+      refill(tier, cls, mag);
+    }
+    void* obj = mag.objects[--mag.count];
+    if (!tracks_live(tier) || acquire_live(obj, slab_size_classes[cls])) {
+      return obj;
+    }
+    // a hole of a chunk under evacuation, dropped for good
+    arenas_[tier].depots[cls].carved_count.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+inline bool node_slab::deallocate(node_mem_type type, void* ptr, size_t size) {
+  int cls = slab_size_class(size);
+  if (cls < 0) {
+    return false;
+  }
+  int tier = tier_index(type);
+  if (tracks_live(tier)) {
+    scrub_local();
+    chunk_header* header = header_of(ptr);
+    header->live_bytes.fetch_sub(slab_size_classes[cls]);
+    if (header->evacuating.load()) {
+      arenas_[tier].depots[cls].carved_count.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  magazine& mag = local_cache().magazines[tier][cls];
+  if (mag.count == slab_magazine_capacity) {
+    flush(tier, cls, mag, slab_magazine_capacity / 2);
+  }
+  mag.objects[mag.count++] = ptr;
+  return true;
+}
+
+}   // namespace sidle
+
+#endif /* SIDLE_SLAB_HH */
@@ -0,0 +1,115 @@
+#ifndef SIDLE_TRAVERSE_HH
+#define SIDLE_TRAVERSE_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sidle {
+
+/// @brief the workers of a traversal, the calling thread included, if SIDLE_TRAVERSE_WORKERS is unset
+constexpr size_t default_traverse_workers = 4;
+/// @brief a worker offers a subtree to the others only while its own deque holds fewer tasks than this
+constexpr size_t traverse_split_threshold = 2;
+
+class traverse_pool;
+
+/// @brief a piece of a parallel traversal, run by whichever worker takes it. It only carries plain
+///        pointers, splitting a subtree off does not allocate
+struct traverse_task {
+  void (*run)(traverse_pool& pool, const traverse_task& task, int worker);
+  void* ctx;
+  void* arg0;
+  void* arg1;
+};
+
+/// @brief a work-stealing pool for the traversals of the background workers. Every worker owns a
+///        deque, it pushes and pops the subtrees it splits off at the back and, once dry, steals from
+///        the front of the others. A subtree is split off only while a worker is idle, so the work
+///        spreads below the root fanout on a skewed tree without a task per node.
+/// @note run must be called in a critical section of node_epoch. The workers enter their own for
+///       the whole run, the section of the caller keeps the nodes handed between them alive.
+class traverse_pool {
+public:
+  traverse_pool() = default;
+  traverse_pool(const traverse_pool&) = delete;
+  traverse_pool& operator=(const traverse_pool&) = delete;
+  ~traverse_pool() { stop(); }
+
+  /// @brief start the workers, the thread calling run is one of them
+  /// @param workers the workers of a run, the caller included
+  /// @param cpus the cpus the started threads are pinned to in turn, empty to leave them unpinned
+  void start(size_t workers, const std::vector<int>& cpus);
+  void stop();
+
+  /// @brief run the tasks and all the tasks they spawn, return once every one is done
+  /// @note runs are serialized, without started workers the caller runs the tasks alone
+  void run(const traverse_task* tasks, size_t n);
+
+  /// @brief run fn(part, worker) for every part in [0, n), the parts are taken in order and stolen
+  ///        by idle workers, for the trees that are split into key ranges up front
+  template <typename F>
+  void run_partitions(size_t n, F& fn) {
+    std::vector<traverse_task> tasks(n);
+    for (size_t i = 0; i < n; ++i) {
+      tasks[i] = {[](traverse_pool&, const traverse_task& task, int worker) {
+        (*static_cast<F*>(task.ctx))(reinterpret_cast<size_t>(task.arg0), worker);
+      }, &fn, reinterpret_cast<void*>(i), nullptr};
+    }
+    run(tasks.data(), n);
+  }
+
+  /// @brief queue a task on the deque of worker
+  /// @pre called by worker from a task of the current run
+  void spawn(int worker, const traverse_task& task);
+
+  /// @return true if a task spawned by worker now would likely be taken by an idle worker
+  inline bool should_split(int worker) const {
+    return idle_.load(std::memory_order_relaxed) > 0 &&
+           deques_[worker].size.load(std::memory_order_relaxed) < traverse_split_threshold;
+  }
+
+  /// @return the workers of a run, the caller included
+  inline size_t worker_count() const { return worker_count_; }
+
+  /// @return the worker the calling thread is in the current run, 0 outside of a run
+  static inline int current_worker() { return worker_id_; }
+
+private:
+  struct alignas(64) task_deque {
+    std::mutex mtx;
+    std::vector<traverse_task> tasks;
+    size_t head{0};                      // the tasks before head have been stolen
+    std::atomic<size_t> size{0};
+  };
+
+  bool pop(int worker, traverse_task& task);
+  bool steal(int worker, traverse_task& task);
+  /// @brief take and run tasks until the run is done
+  void work(int worker);
+  void worker_loop(int worker, int cpu);
+
+  static inline thread_local int worker_id_{0};
+
+  std::unique_ptr<task_deque[]> deques_{new task_deque[1]};
+  size_t worker_count_{1};
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pending_{0};     // the tasks spawned and not yet done
+  std::atomic<int> idle_{0};           // the workers looking for a task
+  std::mutex run_mtx_;
+  std::mutex wakeup_mtx_;
+  std::condition_variable wakeup_cv_;
+  uint64_t generation_{0};
+  bool stopping_{false};
+};
+
+extern traverse_pool traverse_workers;
+
+}   // namespace sidle
+
+#endif /* SIDLE_TRAVERSE_HH */
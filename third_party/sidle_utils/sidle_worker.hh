@@ -1,6 +1,7 @@
 #ifndef SIDLE_WORKER_HH
 #define SIDLE_WORKER_HH
 
+#include <cassert>
 #include <chrono>
 #include <cstring>
 #include <functional>
@@ -18,6 +19,7 @@
 #include "sidle_struct.hh"
 #include "sidle_policy.hh"
 #include "sidle_frontend.hh"
+#include "sidle_copy.hh"
 
 namespace sidle {
 
@@ -43,14 +45,20 @@ struct tree_op {
   using node_traverse_func_t = std::function<void(P*, node_cb_t)>;
   using get_leaf_t = std::function<T*(N*)>;
   using is_leaf_t = std::function<bool(N*)>;
+  using get_parent_t = std::function<P*(P*)>;
 
   traverse_func_t traverse_func_;
+  // a traversal that may call back from several threads at once, used by the migration trigger
+  // and the cooler instead of traverse_func_ if set
+  traverse_func_t parallel_traverse_func_;
   leaf_migration_t leaf_migration_;
   internode_migration_t internode_migration_;
   unlock_func_t unlock_;
   node_traverse_func_t node_traverse_func_;
   get_leaf_t get_leaf_;
   is_leaf_t is_leaf_;
+  // the parent of an internode, used by the art demotion
+  get_parent_t get_parent_;
   tree_type type_;
 };
 
@@ -59,19 +67,23 @@ class sidle_histogram {
 public:
   enum class type { hot = 0, warm, cold };
 
+  /// @param slots the threads updating the histogram at once, each counts in a slot of its own
   sidle_histogram(sidle_threshold* threshold_manager = nullptr,
-    const size_t size = 16): histogram_(size, 0), next_histogram_(size, 0),  
+    const size_t size = 16, const size_t slots = 1): histogram_(size, 0),
+                              next_histogram_(size * slots, 0),
                               threshold_manager_(threshold_manager) {} 
 
   ~sidle_histogram() = default;
 
   /// @brief update node access statistic info and decide its current hotness
-  type update(uint16_t access_count) {
+  /// @param slot the slot of the calling thread, see traverse_pool::current_worker
+  type update(uint16_t access_count, size_t slot = 0) {
+    uint64_t* next = next_histogram_.data() + slot * histogram_.size();
     if (access_count <= 1) {
-      ++next_histogram_[0];
+      ++next[0];
     } else {
       size_t cur_index = get_idx(access_count);
-      ++next_histogram_[cur_index];
+      ++next[cur_index];
     }
     if (access_count > hot_threshold_) {
       return type::hot;
@@ -86,11 +98,16 @@ public:
   void refresh(uint64_t total_number, uint64_t total_access_count) {
     total_number_ = total_number;
     total_access_count_ = total_access_count;
-    // replace the histogram
-    histogram_ = std::move(next_histogram_);
-    next_histogram_.assign(histogram_.size(), 0);
+    // replace the histogram with the sum of the slots
+    histogram_.assign(histogram_.size(), 0);
+    for (size_t i = 0; i < next_histogram_.size(); ++i) {
+      histogram_[i % histogram_.size()] += next_histogram_[i];
+    }
+    next_histogram_.assign(next_histogram_.size(), 0);
   }
 
+  inline size_t slots() const { return next_histogram_.size() / histogram_.size(); }
+
   // refer https://github.com/cosmoss-jigu/memtis
   void adjust_threshold() {
     while (is_cooling.load()) {
@@ -175,7 +192,7 @@ private:
 
   // The x-axis is in exponential form to adapt to the zip distribution
   std::vector<uint64_t> histogram_;
-  /// @brief the next histogram for the next round
+  /// @brief the next histogram for the next round, a histogram per slot
   std::vector<uint64_t> next_histogram_;
   uint16_t hot_threshold_{default_hot_threshold};
   uint16_t cold_threshold_{default_cold_threshold};
@@ -203,7 +220,7 @@ public:
                     H* tree, histogram_ptr_t histogram_, 
                     tree_op_t& tree_ops):
       art_worker_base(interval * 5), histogram_(histogram_), table_(tree), 
-      tree_op_(tree_ops), ti_(nullptr) {
+      leaf_counters_(histogram_->slots()), tree_op_(tree_ops), ti_(nullptr) {
     // initialize the threadinfo
     if (tree_op_.type_ == tree_type::masstree) {
       ti_ = threadinfo::make(threadinfo::TI_MIGRATION, -1);
@@ -252,13 +269,15 @@ public:
 
       ++round_counter_;
       // traverse the tree and check promotion or demotion
+      auto& traverse = tree_op_.parallel_traverse_func_ ? tree_op_.parallel_traverse_func_
+                                                        : tree_op_.traverse_func_;
       if constexpr (sizeof...(Args) > 0) {
-        tree_op_.traverse_func_(table_, 
+        traverse(table_, 
                               [this](P* parent, T* cur) {
           this->trigger_migration_cb(parent, cur);
         }, ti_);
       } else {
-        tree_op_.traverse_func_(table_, 
+        traverse(table_, 
                               [this](P* parent, T* cur) {
           this->trigger_migration_cb(parent, cur);
         }); 
@@ -271,9 +290,13 @@ public:
         std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count());
 #endif
       // refresh the histogram
-      histogram_->refresh(node_counter_, access_counter_);
-      node_counter_ = 0;
-      access_counter_ = 0;
+      uint64_t node_counter = 0, access_counter = 0;
+      for (leaf_counter& counter : leaf_counters_) {
+        node_counter += counter.nodes;
+        access_counter += counter.accesses;
+        counter = leaf_counter{};
+      }
+      histogram_->refresh(node_counter, access_counter);
       // if the queue is not empty, notify the migration executor 
       if (base::queue_.get_promotion_queue_length() > 0 &&
           base::can_promote_.load(std::memory_order_relaxed)) {
@@ -308,10 +331,12 @@ private:
     }
   }
 
+  /// @note called by the workers of a parallel traversal at once, each counts in its own slot
   void trigger_migration_cb(P* parent, T* cur) {
-    node_hotness hotness = histogram_->update(cur->sidle_meta.access_time);
-    ++node_counter_;
-    access_counter_ += cur->sidle_meta.access_time;
+    size_t slot = traverse_pool::current_worker();
+    node_hotness hotness = histogram_->update(cur->sidle_meta.access_time, slot);
+    ++leaf_counters_[slot].nodes;
+    leaf_counters_[slot].accesses += cur->sidle_meta.access_time;
     // check whether promotion operation can be performed at this time
     if (base::can_promote_.load(std::memory_order_relaxed) &&
         cur->sidle_meta.metadata.type == node_mem_type::remote && 
@@ -323,7 +348,7 @@ private:
         // need to store the parent node address to the queue after leaf node
         base::queue_.add_multi_task(task_type::promotion, 
                                     {make_leaf(reinterpret_cast<char*>(cur) + 1), 
-                                    reinterpret_cast<uint64_t>(parent)});
+                                    node_epoch.pin_task(reinterpret_cast<uint64_t>(parent))});
       } else {
         base::queue_.add_task(task_type::promotion, 
                               reinterpret_cast<uint64_t>(cur));         
@@ -339,7 +364,7 @@ private:
       if (tree_op_.type_ == tree_type::art) {
         base::queue_.add_multi_task(task_type::demotion, 
                                   {make_leaf(reinterpret_cast<char*>(cur) + 1), 
-                                  reinterpret_cast<uint64_t>(parent)});
+                                  node_epoch.pin_task(reinterpret_cast<uint64_t>(parent))});
       } else {
         base::queue_.add_task(task_type::demotion,
                             reinterpret_cast<uint64_t>(cur));
@@ -348,12 +373,17 @@ private:
     }
   }
 
+  struct alignas(64) leaf_counter {
+    uint64_t nodes{0};
+    uint64_t accesses{0};
+  };
+
   // sidle_threshold* threshold_manager_;
   histogram_ptr_t histogram_;
   H* table_;
   uint32_t round_counter_{0};
-  uint64_t node_counter_{0};
-  uint64_t access_counter_{0};
+  /// @brief the leaves and their accesses seen in a round, per slot of the histogram
+  std::vector<leaf_counter> leaf_counters_;
   bool call_by_adjuster_{false};
   tree_op_t tree_op_;
   threadinfo *ti_;
@@ -375,6 +405,40 @@ public:
   virtual ~art_executor_base() = default;
 
 protected:
+  /// @brief prefetch a drained task, the leaf address of art is tagged
+  static inline void prefetch_task(uint64_t addr) {
+    if (addr != 0) {
+      prefetch_node(reinterpret_cast<const void*>(addr & ~static_cast<uint64_t>(1)));
+    }
+  }
+
+  /// @brief count a batch of pair tasks in the pin slots of drained, and strip the slots off the tasks
+  static void unpack_tasks(std::pair<uint64_t, uint64_t>* batch, size_t count,
+                           size_t (&drained)[epoch_limbo_count]) {
+    for (size_t i = 0; i < count; ++i) {
+      ++drained[epoch_manager::task_slot(batch[i].second)];
+      batch[i].second = epoch_manager::task_word(batch[i].second);
+    }
+  }
+
+  /// @brief drop the queued pair tasks while the migration is interrupted, counting their pins
+  static void drain_tasks(task_type type, const std::atomic<bool>& allowed,
+                          size_t (&drained)[epoch_limbo_count]) {
+    while (!allowed.load(std::memory_order_relaxed)) {
+      auto task = base::queue_.get_multi_task(type);
+      if (task.first == 0) {
+        break;
+      }
+      ++drained[epoch_manager::task_slot(task.second)];
+    }
+  }
+
+  static void unpin_tasks(const size_t (&drained)[epoch_limbo_count]) {
+    for (int slot = 0; slot < epoch_limbo_count; ++slot) {
+      node_epoch.unpin_tasks(slot, drained[slot]);
+    }
+  }
+
   /// @pre the parent hasn't been lock
   void migrate_leaf(T *cur_node, P* parent, 
                     node_mem_type target_type, threadinfo *ti) {
@@ -396,7 +460,7 @@ protected:
         if (status == migration_state::delay) {
           if (tree_op_.type_ == tree_type::art) {
             base::queue_.add_multi_task(task_type::demotion,
-                                      {reinterpret_cast<uint64_t>(p), 0});
+                                      {reinterpret_cast<uint64_t>(p), node_epoch.pin_task(0)});
           } else {
             base::queue_.add_task(task_type::demotion, 
                                   reinterpret_cast<uint64_t>(p));
@@ -447,7 +511,7 @@ protected:
           "[DEBUG] [migrate_internode] delay node's type should be remote");
       if (tree_op_.type_ == tree_type::art) {
         base::queue_.add_multi_task(task_type::demotion, 
-                                  {reinterpret_cast<uint64_t>(parent), 0}); 
+                                  {reinterpret_cast<uint64_t>(parent), node_epoch.pin_task(0)}); 
       } else {
         base::queue_.add_task(task_type::demotion, reinterpret_cast<uint64_t>(parent));
       }
@@ -476,6 +540,14 @@ private:
       bool has_local = false;
       tree_op_.node_traverse_func_(parent_node, [&has_local, this](N* child) {
         if (this->tree_op_.is_leaf_(child)) {
+          // a tagged art leaf tells its tier without reading the leaf from CXL
+          if (this->tree_op_.type_ == tree_type::art && art::art_leaf_tier_tagged(child)) {
+            if (art::art_leaf_tagged_tier(child) == node_mem_type::local) {
+              has_local = true;
+              return false;
+            }
+            return true;
+          }
           T* leaf = this->tree_op_.get_leaf_(child);
           if (leaf->sidle_meta.metadata.type == node_mem_type::local) {
             has_local = true;
@@ -541,31 +613,57 @@ public:
       }
 
       // SIDLE_RECORD(WORKER_DEBUG, "[art_promotion_executor] wakeup\n");
+      // the drained tasks stay pinned until the end of the run, see epoch_manager::pin_task
+      size_t drained[epoch_limbo_count] = {};
+      if (tree_op_.type_ == tree_type::art) {
+        node_epoch.enter();
+      }
+      // drain the queue in batches and prefetch a whole batch before migrating it,
+      // so the reads of the candidates overlap instead of costing one round trip each
       while (base::can_promote_.load(std::memory_order_relaxed) && 
             base::is_running_) {
-        // get the leaf node address and parent node address
         if (tree_op_.type_ == tree_type::art) {
-          auto [addr, parent_addr] = base::queue_.get_multi_task(task_type::promotion);
-          if (addr == 0 || parent_addr == 0) {
+          // the leaf node address and parent node address
+          size_t count = base::queue_.get_multi_tasks(task_type::promotion, pair_batch_, 
+                                                      migration_batch_size);
+          if (count == 0) {
             break;
           }
-          SIDLE_CHECK(tree_op_.is_leaf_(reinterpret_cast<N*>(addr)), 
-            "[art_promotion_executor] the promotion candidate should be leaf node");
-          this->migrate_leaf(tree_op_.get_leaf_(reinterpret_cast<N*>(addr)),
-              reinterpret_cast<P*>(parent_addr), node_mem_type::local, ti_);
+          this->unpack_tasks(pair_batch_, count, drained);
+          for (size_t i = 0; i < count; ++i) {
+            this->prefetch_task(pair_batch_[i].first);
+            this->prefetch_task(pair_batch_[i].second);
+          }
+          for (size_t i = 0; i < count && base::can_promote_.load(std::memory_order_relaxed); ++i) {
+            auto [addr, parent_addr] = pair_batch_[i];
+            if (addr == 0 || parent_addr == 0) {
+              continue;
+            }
+            SIDLE_CHECK(tree_op_.is_leaf_(reinterpret_cast<N*>(addr)), 
+              "[art_promotion_executor] the promotion candidate should be leaf node");
+            this->migrate_leaf(tree_op_.get_leaf_(reinterpret_cast<N*>(addr)),
+                reinterpret_cast<P*>(parent_addr), node_mem_type::local, ti_);
+          }
         } else {
-          auto addr = base::queue_.get_task(task_type::promotion);
-          if (!addr) {
+          size_t count = base::queue_.get_tasks(task_type::promotion, batch_, migration_batch_size);
+          if (count == 0) {
             break;
           }
-          this->migrate_leaf(tree_op_.get_leaf_(reinterpret_cast<N*>(addr)),
-              nullptr, node_mem_type::local, ti_);
+          for (size_t i = 0; i < count; ++i) {
+            this->prefetch_task(batch_[i]);
+          }
+          for (size_t i = 0; i < count && base::can_promote_.load(std::memory_order_relaxed); ++i) {
+            this->migrate_leaf(tree_op_.get_leaf_(reinterpret_cast<N*>(batch_[i])),
+                nullptr, node_mem_type::local, ti_);
+          }
         }
       }
       // if the promotion is interrupted, clear current promotion queue
       if (tree_op_.type_ == tree_type::art) {
-        while (base::queue_.get_multi_task(task_type::promotion).first && 
-              !base::can_promote_.load(std::memory_order_relaxed)) {}
+        this->drain_tasks(task_type::promotion, base::can_promote_, drained);
+        node_epoch.exit();
+        this->unpin_tasks(drained);
+        node_epoch.try_reclaim();
       } else {
         while (base::queue_.get_task(task_type::promotion) && 
               !base::can_promote_.load(std::memory_order_relaxed)) {}
@@ -577,6 +675,8 @@ public:
 private:
   threadinfo *ti_{nullptr};
   tree_op_t tree_op_;
+  uint64_t batch_[migration_batch_size];
+  std::pair<uint64_t, uint64_t> pair_batch_[migration_batch_size];
 };
 
 /// @brief the background job worker to execute demotion
@@ -610,58 +710,85 @@ public:
       // SIDLE_RECORD(WORKER_DEBUG, "[art_demotion_executor] wakeup\n");
       // flag to indicate that demotion executor's job is running
       base::is_demoting_.store(true);
+      // the drained tasks and the demotion map stay pinned until the end of the run
+      size_t drained[epoch_limbo_count] = {};
+      if (tree_op_.type_ == tree_type::art) {
+        node_epoch.enter();
+      }
+      // drain the queue in batches and prefetch a whole batch before migrating it
       while (base::can_demote_.load(std::memory_order_relaxed) && 
             base::is_running_) {
         if (tree_op_.type_ == tree_type::art) {
-          // get the leaf node address and parent node address
-          auto [addr, parent_addr] = base::queue_.get_multi_task(task_type::demotion);
-          if (!addr) {
+          // the leaf node address and parent node address
+          size_t count = base::queue_.get_multi_tasks(task_type::demotion, pair_batch_, 
+                                                      migration_batch_size);
+          if (count == 0) {
             break;
           }
-          // internode, migrate directly
-          if (parent_addr == 0) {
-            // SIDLE_RECORD(WORKER_DEBUG, 
-            //   "[art_demotion_executor] new internode demotion candidate: %p\n", addr);
-            this->migrate_internode(reinterpret_cast<P*>(addr), 
-                              node_mem_type::remote, 0);
-            continue;
+          this->unpack_tasks(pair_batch_, count, drained);
+          for (size_t i = 0; i < count; ++i) {
+            this->prefetch_task(pair_batch_[i].first);
+            this->prefetch_task(pair_batch_[i].second);
           }
-          // SIDLE_RECORD(WORKER_DEBUG, 
-          //   "[art_demotion_executor] new demotion candidate: %p, parent node: %p\n", 
-          //   addr, parent_addr);
-          T* cur = tree_op_.get_leaf_(reinterpret_cast<N*>(addr));
-          // T* cur = get_leaf(reinterpret_cast<char*>(addr));
-          if constexpr (sizeof...(Args) == 0) {
-            if (cur->sidle_meta.metadata.type == node_mem_type::remote) {
-            find_first_local_ancestor(reinterpret_cast<P*>(parent_addr), 
-                                      reinterpret_cast<P*>(cur));
-            } else {
-              this->migrate_leaf(cur,
-              reinterpret_cast<P*>(parent_addr), node_mem_type::remote, ti_);
+          for (size_t i = 0; i < count && base::can_demote_.load(std::memory_order_relaxed); ++i) {
+            auto [addr, parent_addr] = pair_batch_[i];
+            if (!addr) {
+              continue;
+            }
+            // internode, migrate directly
+            if (parent_addr == 0) {
+              // SIDLE_RECORD(WORKER_DEBUG, 
+              //   "[art_demotion_executor] new internode demotion candidate: %p\n", addr);
+              this->migrate_internode(reinterpret_cast<P*>(addr), 
+                                node_mem_type::remote, 0);
+              continue;
+            }
+            // SIDLE_RECORD(WORKER_DEBUG, 
+            //   "[art_demotion_executor] new demotion candidate: %p, parent node: %p\n", 
+            //   addr, parent_addr);
+            T* cur = tree_op_.get_leaf_(reinterpret_cast<N*>(addr));
+            // T* cur = get_leaf(reinterpret_cast<char*>(addr));
+            if constexpr (sizeof...(Args) == 0) {
+              if (cur->sidle_meta.metadata.type == node_mem_type::remote) {
+              find_first_local_ancestor(reinterpret_cast<P*>(parent_addr), 
+                                        reinterpret_cast<P*>(cur));
+              } else {
+                this->migrate_leaf(cur,
+                reinterpret_cast<P*>(parent_addr), node_mem_type::remote, ti_);
+              }
             }
           }
         } else {
-          auto addr = base::queue_.get_task(task_type::demotion);
-          if (!addr) {
+          size_t count = base::queue_.get_tasks(task_type::demotion, batch_, migration_batch_size);
+          if (count == 0) {
             break;
           }
-          auto node = reinterpret_cast<N*>(addr);
-          if (tree_op_.is_leaf_(node)) {
-            T* cur = tree_op_.get_leaf_(node);
-            this->migrate_leaf(cur, nullptr, node_mem_type::remote, ti_);
-          } else {
-            this->migrate_internode(reinterpret_cast<P*>(node),
-                            node_mem_type::remote, ti_, 0);
+          for (size_t i = 0; i < count; ++i) {
+            this->prefetch_task(batch_[i]);
+          }
+          for (size_t i = 0; i < count && base::can_demote_.load(std::memory_order_relaxed); ++i) {
+            auto node = reinterpret_cast<N*>(batch_[i]);
+            if (tree_op_.is_leaf_(node)) {
+              T* cur = tree_op_.get_leaf_(node);
+              this->migrate_leaf(cur, nullptr, node_mem_type::remote, ti_);
+            } else {
+              this->migrate_internode(reinterpret_cast<P*>(node),
+                              node_mem_type::remote, ti_, 0);
+            }
           }
         }
       }
       base::need_demotion_.store(false);
       base::is_demoting_.store(false);
       // if the demotion is interrupted, clear current demotion queue
-      while (base::queue_.get_multi_task(task_type::demotion).first && 
-            !base::can_demote_.load(std::memory_order_relaxed)) {}
+      this->drain_tasks(task_type::demotion, base::can_demote_, drained);
       // clear the demotion map
       demotion_map_.clear();
+      if (tree_op_.type_ == tree_type::art) {
+        node_epoch.exit();
+        this->unpin_tasks(drained);
+        node_epoch.try_reclaim();
+      }
       // After the demotion is over, the threshold adjuster should be notified
       // to continue execution.
       {
@@ -698,7 +825,8 @@ private:
       }
       return;
     }
-    find_first_local_ancestor(node->parent, node);
+    assert(tree_op_.get_parent_ && "the art demotion needs get_parent_");
+    find_first_local_ancestor(tree_op_.get_parent_(node), node);
   }
 
   /// @brief record the internodes that may need to be demoted
@@ -711,6 +839,8 @@ private:
   std::unordered_map<uint64_t, std::unordered_set<uint64_t>> demotion_map_;
   tree_op_t tree_op_;
   threadinfo* ti_{nullptr};
+  uint64_t batch_[migration_batch_size];
+  std::pair<uint64_t, uint64_t> pair_batch_[migration_batch_size];
 };
 
 /// @brief the background worker to halve all nodes' access time periodically
@@ -741,15 +871,15 @@ public:
 
       // notify the trigger that the art_cooler is running
       histogram_->notify_cooling();
+      auto& traverse = tree_op_.parallel_traverse_func_ ? tree_op_.parallel_traverse_func_
+                                                        : tree_op_.traverse_func_;
       if constexpr (sizeof...(Args) > 0) {
-        tree_op_.traverse_func_(table_, 
-        // art::adaptive_radix_tree_traverse_mt(table_, 
+        traverse(table_, 
         [this](P* parent, T* cur) {
           this->cool_down_cb(parent, cur);
         }, ti_);
       } else {
-        tree_op_.traverse_func_(table_, 
-        // art::adaptive_radix_tree_traverse_mt(table_, 
+        traverse(table_, 
         [this](P* parent, T* cur) {
           this->cool_down_cb(parent, cur);
         });
@@ -772,6 +902,109 @@ private:
   threadinfo *ti_{nullptr};
 };
 
+/// @brief the background worker to compact the local tier. It marks the sparse local chunks of the
+// node slab and relocates their live nodes with the migration primitives, the target tier being the
+// current one, so the chunks drain and go back to local_arena
+/// @note the old copies are retired by the tree, a chunk holding retired nodes is released once they
+// are reclaimed. Only ART runs the compactor, masstree frees its nodes into the pools of threadinfo
+// the slab never sees
+template <typename T, typename P, typename H, typename N, typename... Args>
+class art_compactor : public art_worker_base {
+  static_assert(sizeof...(Args) == 0, "the compactor runs on the art only, the art ops take no threadinfo");
+
+public:
+  using base = art_worker_base;
+  using tree_op_t = tree_op<T, P, H, N, Args...>;
+
+  art_compactor() = default;
+  art_compactor(std::chrono::milliseconds interval, H* tree, tree_op_t& tree_ops):
+      base(interval), table_(tree), tree_op_(tree_ops) {}
+  ~art_compactor() = default;
+
+  void run_job() override {
+    while (base::is_running_) {
+      std::this_thread::sleep_for(base::interval_);
+      // the nodes relocated in the previous rounds leave their chunks once reclaimed
+      node_epoch.try_reclaim();
+      // the chunks evacuated in the previous rounds
+      size_t released = node_allocator.release_evacuated(node_mem_type::local);
+
+      // only the holes left by freed nodes are compacted, the retired nodes still hold their bytes
+      // until they are reclaimed
+      slab_tier_stats stats;
+      node_allocator.get_stats(node_mem_type::local, stats);
+      if (stats.free_bytes < slab_chunk_size ||
+          stats.free_bytes < stats.chunk_bytes * default_compaction_fragmentation) {
+        continue;
+      }
+      size_t marked = node_allocator.begin_evacuation(node_mem_type::local,
+          default_compaction_max_occupancy, default_compaction_max_chunks);
+      if (marked == 0) {
+        continue;
+      }
+
+      // collect the candidates first, the traversal gives up on the nodes replaced under it.
+      // The candidates are read in one critical section with their relocation.
+      node_epoch.enter();
+      leaves_.clear();
+      internodes_.clear();
+      tree_op_.traverse_func_(table_, [this](P* parent, T* cur) {
+        this->collect_cb(parent, cur);
+      });
+      for (auto [cur, parent] : leaves_) {
+        relocate_ancestors(migrate_leaf(cur, parent));
+      }
+      for (P* node : internodes_) {
+        if (node->sidle_meta.type == node_mem_type::local &&
+            node_allocator.evacuating(node_mem_type::local, node)) {
+          relocate_ancestors(migrate_internode(node, true));
+        }
+      }
+      node_epoch.exit();
+      SIDLE_RECORD(WORKER_DEBUG, "[art_compactor] marked %lu chunks, relocated %lu leaves and %lu internodes, "
+                   "released %lu chunks\n", marked, leaves_.size(), internodes_.size(), released);
+    }
+  }
+
+private:
+  void collect_cb(P* parent, T* cur) {
+    if (cur->sidle_meta.metadata.type == node_mem_type::local &&
+        node_allocator.evacuating(node_mem_type::local, cur)) {
+      leaves_.emplace_back(cur, parent);
+    }
+    if (parent != nullptr && parent->sidle_meta.depth > 1 &&
+        parent->sidle_meta.type == node_mem_type::local &&
+        node_allocator.evacuating(node_mem_type::local, parent)) {
+      internodes_.insert(parent);
+    }
+  }
+
+  /// @return the parent, locked
+  P* migrate_leaf(T* cur, P* parent) {
+    return tree_op_.leaf_migration_(cur, parent, node_mem_type::local);
+  }
+
+  /// @return the parent, locked
+  P* migrate_internode(P* node, bool need_lock_first) {
+    return tree_op_.internode_migration_(node, node_mem_type::local, need_lock_first);
+  }
+
+  /// @brief relocate the locked node and its ancestors while they are in chunks under evacuation
+  void relocate_ancestors(P* node) {
+    while (node != nullptr && node->sidle_meta.depth > 1 &&
+           node->sidle_meta.type == node_mem_type::local &&
+           node_allocator.evacuating(node_mem_type::local, node)) {
+      node = migrate_internode(node, false);
+    }
+    tree_op_.unlock_(node);
+  }
+
+  H* table_;
+  tree_op_t tree_op_;
+  std::vector<std::pair<T*, P*>> leaves_;
+  std::unordered_set<P*> internodes_;
+};
+
 /// @brief adjust the threshold according to the watermark, and schedule other
 // workers
 class art_threshold_adjuster : public art_worker_base {